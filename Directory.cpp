@@ -2,279 +2,618 @@
 #include "Directory.h"
 #include "RegularFile.h"
 #include "SoftLinkedFile.h"
+#include "Inode.h"
+#include "Jobs.h"
+#include "Mount.h"
+#include "OutputBuffer.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fnmatch.h>
+#include <functional>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
 using namespace std;
 
 namespace GTUShell {
 
     File::iterator Directory::begin() const {
-        // In order to return the file information as std::string::const_iterator, this function
-        // receives file information from the files vector and turns it into a string
-        updateFilesAsString();
-        // Return the newly updated string as the beginning iterator
-        return filesAsString.begin();
+        ensureLoaded();
+        // The children are formatted while iterating, nothing is built up front
+        return FileIterator(&files, 0, &version);
     }
 
     File::iterator Directory::end() const {
-        // In order to return the file information as std::string::const_iterator, this function
-        // receives file information from the files vector and turns it into a string
-        updateFilesAsString();
-        // Return the newly updated string as the end iterator
-        return filesAsString.end();
+        ensureLoaded();
+        return FileIterator(&files, files.size(), &version);
     }
 
-    void Directory::readDiskFile() {
-        // Clear the previously saved files
-        files.clear();
+    void Directory::cat(std::ostream& out) const {
+        // Same bytes as File::cat writes through the FileIterator of the directory ("T\tname" lines and a final
+        // \n), but one child at a time instead of one byte at a time
+        ensureLoaded();
+        bool first = true;
+        for (const auto& filePtr : files) {
+            if (!first)
+                out << "\n";
+            out << filePtr->getType() << "\t" << filePtr->getName();
+            first = false;
+        }
 
-        // Try to open the disk
-        ifstream inputStream("disk.txt");
-        if (!inputStream.is_open())
-            throw ContentsFileNotFound();
+        out << "\n";
+    }
 
-        string line;
-        string placeholder = "~0~";
+    void Directory::readDiskFile(std::ostream& messages) {
+        TraceSpan span("readDiskFile");
 
-        // Store directories by their paths
-        map<string, shared_ptr<Directory>> directories;
+        // Release the previously loaded files
+        for (File* filePtr : files)
+            arena->release(filePtr);
+        files.clear();
+        filesByName.clear();
+        childrenChanged();
+
+        vector<FileData> records = disk->load(messages);
+        span.count(disk->physicalSize(), records.size());
+        bool inodeLayout = std::any_of(records.begin(), records.end(), [](const FileData& record) {
+            return record.path.compare(0, 1, "#") == 0;
+        });
+        if (inodeLayout) {
+            loadInodes(records);
+            return;
+        }
+        if (records.empty())
+            return;
 
-        while (getline(inputStream, line)) {
-            // Turn the line into a string stream so that getline function can work on it
-            stringstream ss(line);
+        // Convert the disk to inode records. The new records are queued before the old ones are removed, so an
+        // interrupted conversion leaves both and the inode records are used the next time.
+        vector<string> paths;
+        for (const auto& record : records)
+            paths.push_back(record.path);
+        loadPaths(records);
+
+        vector<FileData> batch;
+        if (!files.empty() && files.front()->getInode() == inode)
+            batch.push_back({ 'D', ".", inodeKey(InodeTable::rootNumber), Timestamp::format(inode->time), 0, "" });
+        vector<const Directory*> pending = { this };
+        while (!pending.empty()) {
+            const Directory* dir = pending.back();
+            pending.pop_back();
+            for (const File* filePtr : dir->files) {
+                // The "." entry is the root itself
+                if (filePtr->getInode() == dir->inode)
+                    continue;
+                addRecords(*filePtr, true, batch);
+                if (filePtr->getType() == 'D')
+                    pending.push_back(static_cast<const Directory*>(filePtr));
+            }
+        }
+        disk->append(batch);
+        disk->removeRecords(paths);
+    }
 
-            // This FileData object will hold the information of the file that is currently being read
-            FileData temp;
-            string tempType;
-            getline(ss, tempType, '\t');
+    void Directory::loadPaths(vector<FileData>& records) {
+        // Store directories by their paths, this directory is the root
+        unordered_map<string, Directory*> directories;
+        directories["/"] = this;
 
+        for (FileData& temp : records) {
             // Check the type to see if it is a type the system knows
-            if (tempType != "F" && tempType != "S" && tempType != "D") {
-                throw FileTypeInvalid();
+            if (temp.type != 'F' && temp.type != 'S' && temp.type != 'D')
+                throw FileTypeInvalid(disk->getPath());
 
+            // The record of the root itself (".") is listed in the root, the files of the root are not put in it
+            if (temp.path == "/") {
+                inode->time = Timestamp::parse(temp.date);
+                addFile(arena->createEntry(".", inode, disk));
+                continue;
             }
 
-            temp.type = tempType[0]; // Get the file type character
-            getline(ss, temp.path, '\t'); // Save the path as a string
-            getline(ss, temp.name, '\t'); // Save the name as a string
-            getline(ss, temp.date, '\t'); // Save the date as a string
-            ss >> temp.size; // Save the size as an integer
-
-            // Read the next line (placeholder\ncontent\nplaceholder is the format)
-            bool readingContent = false;
-            while (getline(inputStream, line)) {
-                if (line == placeholder) {
-                    if (readingContent) {
-                        // First placeholder is passed, continue to read the content
-                        break;
-                    } else {
-                        // Currently at the first placeholder, start reading after it
-                        readingContent = true;
-                        continue;
-                    }
-                }
+            // Make a node in the arena with the proper File type
+            string path = std::move(temp.path);
+            char type = temp.type;
+            File* filePtr = arena->create(std::move(temp), disk);
 
-                if (readingContent) {
-                    if (!temp.content.empty()) {
-                        temp.content += '\n'; // Add a new line if not at the first line
-                    }
+            // Make the hierarchy of nested files by creating parent directories/inserting their files
+            if (type == 'D')
+                directories[path] = static_cast<Directory*>(filePtr);
+
+            // Find the position of the last slash for finding the parent directory
+            size_t lastSlash = path.find_last_of("/");
+            if (lastSlash != string::npos) {
+                // Create the parent path by creating a substr
+                string parentPath = path.substr(0, lastSlash);
+                if (parentPath.empty()) parentPath = "/"; // Root directory
 
-                    temp.content += line;
+                auto parentIt = directories.find(parentPath);
+                if (parentIt == directories.end()) {
+                    // Parent directory does not exist, create it (it can not be reached from the root)
+                    FileData parentData = { 'D', "", parentPath, "0", 0, "" };
+                    parentIt = directories.emplace(parentPath, static_cast<Directory*>(arena->create(parentData, disk))).first;
                 }
+                parentIt->second->addFile(filePtr);
             }
+        }
+    }
 
-            // Make a File shared_ptr to be stored in the files vector with the proper File type
-            shared_ptr<File> filePtr;
+    void Directory::loadInodes(vector<FileData>& records) {
+        InodeTable& inodes = arena->inodes();
 
-            switch (temp.type) {
-                case 'F': // Regular File
-                    filePtr = std::make_shared<RegularFile>(temp);
-                    break;
-                case 'S': // Soft Linked File
-                    filePtr = std::make_shared<SoftLinkedFile>(temp, make_shared<Directory>(*this));
-                    break;
-                case 'D': // Directory
-                    filePtr = std::make_shared<Directory>();
-                    break;
-                default:
-                    throw FileTypeInvalid();
+        // Entries by the number of their directory, in the order they were written
+        unordered_map<uint64_t, vector<std::pair<string, uint64_t> > > entriesOf;
+        bool hasRootRecord = false;
+        for (FileData& record : records) {
+            // Records of the older layout left by an interrupted conversion are not used
+            if (record.path.compare(0, 1, "#") != 0)
+                continue;
+
+            uint64_t number = strtoull(record.path.c_str() + 1, nullptr, 10);
+            if (record.type == 'A') {
+                // Bytes appended to the inode after its record was written
+                if (Inode* appendedTo = inodes.get(number)) {
+                    appendedTo->append(record.content);
+                    appendedTo->appendRecords++;
+                    appendedTo->time = Timestamp::parse(record.date);
+                }
+            } else if (record.type == 'E') {
+                entriesOf[number].emplace_back(std::move(record.name), strtoull(record.content.c_str(), nullptr, 10));
+            } else if (number == InodeTable::rootNumber) {
+                inode->time = Timestamp::parse(record.date);
+                hasRootRecord = true;
+            } else {
+                inodes.create(std::move(record), number);
             }
+        }
 
-            filePtr->setData(temp);
+        // The record of the root itself is listed in the root as "."
+        if (hasRootRecord)
+            addFile(arena->createEntry(".", inode, disk));
 
-            // Make the hierarchy of nested files by creating parent directories/inserting their files
+        vector<Directory*> pending = { this };
+        while (!pending.empty()) {
+            Directory* dir = pending.back();
+            pending.pop_back();
+            auto entriesIt = entriesOf.find(dir->inode->number);
+            if (entriesIt == entriesOf.end())
+                continue;
 
-            string parentPath;
-            // Save the directories into the map
-            directories[temp.path] = std::static_pointer_cast<Directory>(filePtr);
+            for (const auto& entry : entriesIt->second) {
+                // A directory has only one entry, a second one would make a loop
+                Inode* childInode = inodes.get(entry.second);
+                if (!childInode || (childInode->type == 'D' && childInode->linkCount > 0))
+                    continue;
 
-            // Find the position of the last slash for finding the parent directory
-            size_t lastSlash = temp.path.find_last_of("/");
-            if (lastSlash != string::npos) {
-                // If slash was found
-                // Create the parent path by creating a substr
-                parentPath = temp.path.substr(0, lastSlash);
-                if (parentPath.empty()) parentPath = "/"; // Root directory
-                if (directories.find(parentPath) != directories.end()) {
-                    // Parent directory exists, add the file in it
-                    directories[parentPath]->addFile(filePtr);
-                } else {
-                    // Parent directory does not exist, create it
-                    shared_ptr<Directory> parentDir = std::make_shared<Directory>();
-                    directories[parentPath] = parentDir;
-                    directories[parentPath]->addFile(filePtr);
-                }
+                File* filePtr = arena->createEntry(entry.first, childInode, disk);
+                dir->addFile(filePtr);
+                if (childInode->type == 'D')
+                    pending.push_back(static_cast<Directory*>(filePtr));
             }
+        }
+
+        // Inodes that no entry refers to are left over from interrupted operations
+        inodes.releaseUnlinked();
+    }
+
+    string Directory::inodeKey(uint64_t number) {
+        return "#" + std::to_string(number);
+    }
+
+    string Directory::entryKey(uint64_t directoryNumber, const string& name) {
+        return inodeKey(directoryNumber) + "/" + name;
+    }
+
+    FileData Directory::rootRecord() {
+        FileData record = { 'D', ".", inodeKey(InodeTable::rootNumber), "0", 0, "" };
+        setTimeToNow(record);
+        return record;
+    }
+
+    void Directory::setTimeToNow(FileData& data) {
+        data.date = Timestamp::format(Timestamp::now());
+    }
 
-            // Only add the file to the files vector if the path is root
-            if (parentPath == "/") {
-                files.push_back(filePtr);
+    void Directory::addRecords(const File& entry, bool withInode, vector<FileData>& batch) {
+        const Inode& entryInode = *entry.getInode();
+        string date = Timestamp::format(entryInode.time);
+        if (withInode) {
+            int baseSize = entryInode.size - static_cast<int>(entryInode.appended().size());
+            batch.push_back({ entryInode.type, entry.getName(), inodeKey(entryInode.number), date,
+                              baseSize, entryInode.content, entryInode.compressed });
+            if (!entryInode.appended().empty()) {
+                batch.push_back({ 'A', entry.getName(), inodeKey(entryInode.number), date,
+                                  static_cast<int>(entryInode.appended().size()), entryInode.appended() });
             }
         }
+        batch.push_back({ 'E', entry.getName(), entryKey(entry.getParent()->inode->number, entry.getName()),
+                          date, 0, std::to_string(entryInode.number) });
+    }
 
-        inputStream.close();
+    void Directory::addToDiskFile(const File& entry, bool withInode) const {
+        // The records become durable with the next sync of the disk
+        vector<FileData> batch;
+        addRecords(entry, withInode, batch);
+        disk->append(batch);
     }
 
-    void Directory::setTimeToNow(FileData& data) {
-        auto currentTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        std::tm localTime = *std::localtime(&currentTime);
+    void Directory::setDisk(const shared_ptr<DiskImage>& diskVal) {
+        disk = diskVal;
+    }
+
+    shared_ptr<DiskImage> Directory::getDisk() const {
+        return disk;
+    }
+
+    void Directory::setArena(NodeArena* arenaVal) {
+        arena = arenaVal;
+    }
+
+    NodeArena* Directory::getArena() const {
+        return arena;
+    }
 
-        char formattedTime[50];
-        std::strftime(formattedTime, sizeof(formattedTime), "%b %d %Y %H:%M", &localTime);
+    const vector<File*>& Directory::getFiles() const {
+        ensureLoaded();
+        return files;
+    }
 
-        data.date = formattedTime;
+    void Directory::addFile(File* file) {
+        ensureLoaded();
+        files.push_back(file);
+        filesByName.emplace(file->getName(), file);
+        file->parent = this;
+        childrenChanged();
     }
 
-    void Directory::addToDiskFile(const FileData& data) {
-        std::ofstream outputStream("disk.txt", std::ios_base::app);
+    void Directory::detachFile(File* file) {
+        auto range = filesByName.equal_range(file->getName());
+        for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+            if (indexIt->second == file) {
+                filesByName.erase(indexIt);
+                break;
+            }
+        }
+        files.erase(std::find(files.begin(), files.end(), file));
+        file->parent = nullptr;
+        childrenChanged();
+    }
 
-        if (!outputStream.is_open())
-            throw ContentsFileNotFound();
+    void Directory::childrenChanged() {
+        version++;
+        if (arena)
+            arena->entriesChanged();
+    }
 
-        auto currentTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        std::tm localTime = *std::localtime(&currentTime);
+    void Directory::detachMount(Directory& mountRoot) {
+        detachFile(&mountRoot);
+    }
 
-        char formattedTime[50];
-        std::strftime(formattedTime, sizeof(formattedTime), "%b %d %Y %H:%M", &localTime);
+    void Directory::setMount(Mount* mountVal) {
+        mount = mountVal;
+    }
 
-        outputStream << data.type << "\t" << data.path << "\t" << data.name << "\t" << formattedTime << "\t" << data.size
-                     << "\n" << "~0~" << "\n" << data.content << "\n" << "~0~" << "\n";
+    Mount* Directory::getMount() const {
+        return mount;
+    }
 
-        outputStream.close();
+    void Directory::loadMount() const {
+        mount->load();
     }
 
-    void Directory::updateFilesAsString() const {
-        // Turns the files vector's information into a string for the iterator to use
-        filesAsString.clear();
-        string typeVal;
+    void Directory::collectKeys(const File& entry, unordered_map<const Inode*, uint32_t>& removedLinks,
+                                vector<string>& keys) {
+        // The records of a mounted image are not on this disk, it has to be unmounted first
+        if (entry.getType() == 'D' && static_cast<const Directory&>(entry).mount)
+            throw MountPointBusy(entry.getPath());
+        keys.push_back(entryKey(entry.getParent()->inode->number, entry.getName()));
+        removedLinks[entry.getInode()]++;
+        if (entry.getType() == 'D') {
+            for (const File* child : static_cast<const Directory&>(entry).getFiles())
+                collectKeys(*child, removedLinks, keys);
+        }
+    }
 
-        // Add the type and name of the file into the string
-        for (const auto& filePtr : files) {
-            typeVal = string(1, filePtr->getType());
-            filesAsString += typeVal + "\t" + filePtr->getName() + "\n";
+    void Directory::removeEntries(const vector<File*>& entries) {
+        unordered_set<const File*> removed;
+        vector<string> keys;
+        unordered_map<const Inode*, uint32_t> removedLinks;
+        for (const File* entry : entries) {
+            if (removed.insert(entry).second)
+                collectKeys(*entry, removedLinks, keys);
         }
 
-        // Remove the last \n
-        if(!filesAsString.empty())
-            filesAsString.erase(filesAsString.size() - 1);
-    }
+        // An inode record goes with the last entry that refers to it, hard links elsewhere keep it
+        for (const auto& links : removedLinks) {
+            if (links.second >= links.first->linkCount)
+                keys.push_back(inodeKey(links.first->number));
+        }
+        disk->removeRecords(keys);
 
-    vector<shared_ptr<File> > Directory::getFiles() const {
-        return files;
+        auto isRemoved = [&removed](const File* filePtr) {
+            return removed.count(filePtr) > 0;
+        };
+
+        // One pass over the vector, so removing many children does not move the rest once per child
+        vector<File*> released;
+        for (File* filePtr : files) {
+            if (!isRemoved(filePtr))
+                continue;
+            auto range = filesByName.equal_range(filePtr->getName());
+            for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+                if (indexIt->second == filePtr) {
+                    filesByName.erase(indexIt);
+                    break;
+                }
+            }
+            released.push_back(filePtr);
+        }
+        files.erase(std::remove_if(files.begin(), files.end(), isRemoved), files.end());
+        for (File* filePtr : released)
+            arena->release(filePtr);
+        childrenChanged();
     }
 
-    void Directory::addFile(const shared_ptr<File>& file) {
-        files.push_back(file);
+    Directory* Directory::findDirectory(const string& name) const {
+        ensureLoaded();
+        auto range = filesByName.equal_range(name);
+        for (auto it = range.first; it != range.second; ++it) {
+            // The "." entry of the root is the root itself and must never be descended into
+            if (it->second->getType() == 'D' && it->second->getInode() != inode)
+                return static_cast<Directory*>(it->second);
+        }
+        return nullptr;
     }
 
-    void Directory::removeFile(const vector<shared_ptr<File>>::iterator& it) {
-        files.erase(it);
+    File* Directory::findFile(const string& name) const {
+        // Children with the same name are kept in the order they were added
+        ensureLoaded();
+        auto it = filesByName.find(name);
+        return it == filesByName.end() ? nullptr : it->second;
     }
 
-    void Directory::ls(string currentPath, const Directory& dir, const Directory& root) const {
-        // If not in root (.) directory:
-        // Print the current directory information with the name "."
-        // ---
-        // Find the parent directory and print it with the name ".."
-        // ---
-        // Print all the files inside the current directory
+    File* Directory::findPath(const string& path) const {
+        const Directory* dir = this;
+        File* found = const_cast<Directory*>(this);
 
-        char type = this->getType();
-        string name = this->getName();
-        string date = this->getDate();
-        string path;
+        std::istringstream pathStream(path);
+        string name;
+        while (getline(pathStream, name, '/')) {
+            if (name.empty())
+                continue;
+            if (!dir)
+                return nullptr;
+            found = dir->findFile(name);
+            if (!found)
+                return nullptr;
+            dir = (found->getType() == 'D') ? static_cast<const Directory*>(found) : nullptr;
+        }
+        return found;
+    }
 
-            if (name != ".") {
-                cout << std::left << std::setw(4) << type << std::setw(20) << "."
-                     << date << "\n";
+    bool Directory::isGlob(const string& word) {
+        return word.find_first_of("*?[") != string::npos;
+    }
 
-                // ---
+    vector<File*> Directory::glob(const string& pattern) const {
+        // Only the names that start with the literal part of the pattern are tested
+        ensureLoaded();
+        string prefix = pattern.substr(0, pattern.find_first_of("*?[\\"));
 
-                // Find the parent directory
-                size_t lastSlash = currentPath.find_last_of("/");
-                currentPath = (lastSlash == 0) ? "/" : currentPath.substr(0, lastSlash);
+        vector<File*> matches;
+        for (auto it = filesByName.lower_bound(prefix); it != filesByName.end(); ++it) {
+            if (it->first.compare(0, prefix.size(), prefix) != 0)
+                break;
+            if (fnmatch(pattern.c_str(), it->first.c_str(), FNM_PERIOD) == 0)
+                matches.push_back(it->second);
+        }
+        return matches;
+    }
 
-                bool success = false;
-                // Now currentPath holds the path of the parentDirectory, find it and display it's information
-                for (const auto &filePtr: root.getFiles()) {
-                    type = filePtr->getType();
-                    date = filePtr->getDate();
-                    path = filePtr->getPath();
+    namespace {
+        // Starts an object of a JSON listing
+        void beginJsonRow(OutputBuffer& buffer, const File& entry, bool& first) {
+            buffer.add(first ? "\n{\"type\":\"" : ",\n{\"type\":\"");
+            buffer.add(entry.getType());
+            buffer.add("\",\"name\":");
+            buffer.addJson(entry.getName());
+            first = false;
+        }
 
-                    if (type == 'D' && path == currentPath) {
-                        cout << std::left << std::setw(4) << type << std::setw(20) << ".."
-                             << date << "\n";
-                        success = true;
-                        break;
-                    }
-                }
-                if (!success) {
-                    cout << std::left << std::setw(4) << 'D' << std::setw(20) << ".."
-                         << date << "\n";
+        void endJsonRow(OutputBuffer& buffer, const File& entry) {
+            buffer.add(",\"date\":\"");
+            buffer.addDate(entry.getTime());
+            buffer.add("\",\"size\":");
+            buffer.addNumber(entry.getSize());
+            buffer.add('}');
+        }
+
+        // Adds a row of ls, only regular files show their size in the text format
+        void addRow(OutputBuffer& buffer, const File& entry, Directory::ListFormat format, bool& first) {
+            if (format == Directory::ListFormat::json) {
+                beginJsonRow(buffer, entry, first);
+                endJsonRow(buffer, entry);
+            } else if (format == Directory::ListFormat::nul) {
+                buffer.add(entry.getName());
+                buffer.add('\0');
+            } else {
+                buffer.addPadded(entry.getType(), 4);
+                buffer.addPadded(entry.getName(), 20);
+                buffer.addDate(entry.getTime());
+                if (entry.getType() == 'F') {
+                    buffer.add('\t');
+                    buffer.addNumber(entry.getSize());
                 }
+                buffer.add('\n');
             }
+        }
+    }
+
+    void Directory::ls(std::ostream& out, const ListOptions& options, std::ostream& errors) const {
+        ensureLoaded();
+        vector<const File*> page;
+        if (!selectPage(options, page, errors))
+            return;
 
-        // ---
+        OutputBuffer buffer(out);
+        bool first = true;
+        if (options.format == ListFormat::json)
+            buffer.add('[');
+
+        // The first page of the text listing starts with the directory itself as "." and its parent as "..",
+        // the machine readable formats only list the children
+        if (options.format == ListFormat::text && options.order == ListOrder::added && options.offset == 0
+            && options.after.empty()) {
+            if (getParent()) {
+                buffer.addPadded(getType(), 4);
+                buffer.addPadded(".", 20);
+                buffer.addDate(getTime());
+                buffer.add('\n');
+                buffer.addPadded('D', 4);
+                buffer.addPadded("..", 20);
+                buffer.addDate(getParent()->getTime());
+                buffer.add('\n');
+            } else if (!files.empty() && files.front()->getInode() == getInode()) {
+                addRow(buffer, *files.front(), options.format, first);
+            }
+        }
 
-        int size;
-        // Print the files inside the directory
-        for (const auto &filePtr: dir.getFiles()) {
-            type = filePtr->getType();
-            name = filePtr->getName();
-            date = filePtr->getDate();
-            size = filePtr->getSize();
+        for (const File* filePtr : page)
+            addRow(buffer, *filePtr, options.format, first);
 
-            if (type == 'F') {
-                // Type is RegularFile will print the size of it
-                cout << std::left << std::setw(4) << type << std::setw(20) << name
-                     << date << "\t" << size << "\n";
-            } else {
-                // Type is DirectorySoftLinkedFile, will not print the size of it
-                cout << std::left << std::setw(4) << type << std::setw(20) << name
-                     << date << "\n";
+        if (options.format == ListFormat::json)
+            buffer.add(first ? "]\n" : "\n]\n");
+    }
+
+    bool Directory::selectPage(const ListOptions& options, vector<const File*>& page, std::ostream& errors) const {
+        // The "." entry of the root is the root itself, it is not a child
+        auto isSelf = [this](const File* filePtr) { return filePtr->getInode() == getInode(); };
+        size_t pageEnd = options.limit > SIZE_MAX - options.offset ? SIZE_MAX : options.offset + options.limit;
+
+        // The name order and the order of addition are kept up to date, their pages are read from the cursor on
+        if (options.order == ListOrder::name) {
+            auto it = options.after.empty() ? filesByName.begin() : filesByName.upper_bound(options.after);
+            for (size_t row = 0; it != filesByName.end() && row < pageEnd; ++it) {
+                if (isSelf(it->second))
+                    continue;
+                if (row++ >= options.offset)
+                    page.push_back(it->second);
+            }
+            return true;
+        }
+
+        if (options.order == ListOrder::added) {
+            auto it = files.begin();
+            if (!options.after.empty()) {
+                it = std::find_if(files.begin(), files.end(), [&](const File* filePtr) {
+                    return filePtr->getName() == options.after && !isSelf(filePtr);
+                });
+                if (it == files.end()) {
+                    errors << "No such file: " << options.after << "\n";
+                    return false;
+                }
+                ++it;
+            }
+            for (size_t row = 0; it != files.end() && row < pageEnd; ++it) {
+                if (isSelf(*it))
+                    continue;
+                if (row++ >= options.offset)
+                    page.push_back(*it);
+            }
+            return true;
+        }
+
+        bool bySize = options.order == ListOrder::size;
+        auto before = [bySize](const File* first, const File* second) {
+            if (bySize && first->getSize() != second->getSize())
+                return first->getSize() > second->getSize();
+            if (!bySize && first->getTime() != second->getTime())
+                return first->getTime() > second->getTime();
+            return first->getName() < second->getName();
+        };
+
+        const File* cursor = nullptr;
+        if (!options.after.empty()) {
+            cursor = findFile(options.after);
+            if (!cursor) {
+                errors << "No such file: " << options.after << "\n";
+                return false;
             }
         }
+
+        vector<const File*> candidates;
+        candidates.reserve(files.size());
+        for (const File* filePtr : files) {
+            if (!isSelf(filePtr) && (!cursor || before(cursor, filePtr)))
+                candidates.push_back(filePtr);
+        }
+
+        // Only the rows up to the end of the page are put in order
+        size_t sortedRows = std::min(pageEnd, candidates.size());
+        if (options.offset >= sortedRows)
+            return true;
+        std::partial_sort(candidates.begin(), candidates.begin() + sortedRows, candidates.end(), before);
+        page.assign(candidates.begin() + options.offset, candidates.begin() + sortedRows);
+        return true;
     }
 
-    void Directory::lsRecursive(const GTUShell::Directory &dir) const {
-        // ls -R
-        char type;
-        string path;
-        string name;
-        for(const auto& filePtr : dir.getFiles()) {
-            type = filePtr->getType();
-            path = filePtr->getPath();
-            name = filePtr->getName();
-            if(type == 'D' && path != "/") {
-                cout << std::left << std::setw(4) << type << std::setw(20) << name << "\t" << path << "\n";
-                auto subDir = std::dynamic_pointer_cast<Directory>(filePtr);
-                if (subDir && subDir.get() != this)  // Avoid going through the same directory again
-                    lsRecursive(*subDir); // Recursively go through the subdirectory
+    void Directory::lsRecursive(std::ostream& out, ListFormat format) const {
+        OutputBuffer buffer(out);
+
+        // The paths are built while walking down instead of from the parents of every entry
+        string path = getParent() ? getPath() : "";
+        bool first = true;
+        if (format == ListFormat::json)
+            buffer.add('[');
+        listTree(buffer, format, path, first);
+        if (format == ListFormat::json)
+            buffer.add(first ? "]\n" : "\n]\n");
+    }
+
+    void Directory::listTree(OutputBuffer& buffer, ListFormat format, string& path, bool& first) const {
+        ensureLoaded();
+        JobControl::checkKilled();
+        size_t pathLength = path.size();
+        for (const File* filePtr : files) {
+            // The "." entry of the root is the root itself, the root of a mounted image is listed by its name
+            bool self = filePtr->getInode() == getInode();
+            if (self && (format != ListFormat::text || getParent()))
+                continue;
+            if (!self) {
+                path += '/';
+                path += filePtr->getName();
+            }
+
+            if (format == ListFormat::text) {
+                buffer.addPadded(filePtr->getType(), 4);
+                buffer.addPadded(filePtr->getName(), 20);
+                buffer.add('\t');
+                if (path.empty())
+                    buffer.add('/');
+                else
+                    buffer.add(path);
+                buffer.add('\n');
+            } else if (format == ListFormat::json) {
+                beginJsonRow(buffer, *filePtr, first);
+                buffer.add(",\"path\":");
+                buffer.addJson(path);
+                endJsonRow(buffer, *filePtr);
             } else {
-                cout << std::left << std::setw(4) << type << std::setw(20) << name << "\t" << path << "\n";
+                buffer.add(path);
+                buffer.add('\0');
             }
+
+            if (filePtr->getType() == 'D' && !self)
+                static_cast<const Directory*>(filePtr)->listTree(buffer, format, path, first); // Recursively go through the subdirectory
+            path.resize(pathLength);
         }
     }
 
-    void Directory::mkdir(const string& dirName, const string& currentPath) {
+    void Directory::mkdir(const string& dirName) {
         // If the directory with the same name already exists, throw an exception.
         for(const auto& filePtr : getFiles()) {
             if(filePtr -> getType() == 'D' && filePtr -> getName() == dirName) {
@@ -282,65 +621,38 @@ namespace GTUShell {
             }
         }
 
-        // Add a / to the path if needed
-        string pathValue;
-        if(currentPath.back() == '/') pathValue = currentPath + dirName;
-        else pathValue = currentPath + "/" + dirName;
+        disk->reserve(2 * recordOverhead);
 
         // Create the data of the file
-        FileData dirData = { 'D', dirName, pathValue, "0", 0, "" };
+        FileData dirData = { 'D', dirName, "", "0", 0, "" };
         setTimeToNow(dirData);
 
         // Create the directory with the specified data and add it to both disk and memory
-        Directory newDir;
-        newDir.setData(dirData);
-
-        addFile(std::make_shared<Directory>(newDir));
-        addToDiskFile(dirData);
+        File* dir = arena->create(dirData, disk);
+        addFile(dir);
+        addToDiskFile(*dir, true);
     }
 
-    void Directory::cd(string& currentPath, const Directory& root, Directory& currentDirectory, const string& newDir) {
+    Directory* Directory::cd(const Directory& currentDirectory, const string& newDir, std::ostream& errors) {
 
         if(newDir.empty() || newDir == ".") {
             // Do nothing
-        } else if (newDir == ".." && currentPath != "/") {
+            return nullptr;
+        } else if (newDir == ".." && currentDirectory.getParent()) {
             // Change the directory one up, to the parent (if currently not in root)
-
-            // Find the parent directory
-            size_t lastSlash = currentPath.find_last_of("/");
-            currentPath = (lastSlash == 0) ? "/" : currentPath.substr(0, lastSlash);
-            currentDirectory = root;
-
-            istringstream pathStream(currentPath);
-            string dirName;
-            while (getline(pathStream, dirName, '/')) {
-                for (const auto& filePtr : currentDirectory.getFiles()) {
-                    if (filePtr->getType() == 'D' && filePtr->getName() == dirName) {
-                        // Change the currentDir to the parent directory that was found
-                        currentDirectory = *(dynamic_pointer_cast<Directory>(filePtr));
-                        break;
-                    }
-                }
-            }
+            return currentDirectory.getParent();
         } else { // Not a special input
             // Change the directory to the new one
-            bool executedFlag = false;
-            for (const auto& filePtr : currentDirectory.getFiles()) {
-                if (filePtr->getType() == 'D' && filePtr->getName() == newDir) {
-                    currentDirectory = *(dynamic_pointer_cast<Directory>(filePtr));
-                    currentPath = filePtr->getPath();
-                    executedFlag = true;
-                    break;
-                }
-            }
-            if (!executedFlag) {
-                cout << "No such directory: " << newDir << "\n";
-            }
+            auto subDir = currentDirectory.findDirectory(newDir);
+            if (!subDir)
+                errors << "No such directory: " << newDir << "\n";
+            return subDir;
         }
     }
 
-    void Directory::link(const string& sourceFile, const string& targetName, const Directory& root) {
+    void Directory::link(std::ostream& errors, const string& sourceFile, const string& targetName) {
         // Creates a new file named targetFile which will have the path of sourceFile in its content
+        ensureLoaded();
         string sourceFilePath;
         for(const auto& filePtr : files) {
             if(filePtr->getType() == 'F' && filePtr->getName() == sourceFile) {
@@ -350,156 +662,89 @@ namespace GTUShell {
         }
 
         if(sourceFilePath.empty()) {
-            cout << "No such file: " << targetName << "\n";
+            errors << "No such file: " << targetName << "\n";
             return;
         }
 
-        string currentPath = getPath();
-        string pathValue;
-
-        // Add / if needed
-        if(currentPath.back() == '/') pathValue = currentPath + targetName;
-        else pathValue = currentPath + "/" + targetName;
-
         // Specify the information of the new file
         FileData temp = {
-                'S', targetName, pathValue, "0", 0, sourceFilePath
+                'S', targetName, "", "0", 0, sourceFilePath
         };
 
+        disk->reserve(2 * recordOverhead + sourceFilePath.size());
         setTimeToNow(temp);
-        addToDiskFile(temp);
-        addFile(std::make_shared<SoftLinkedFile>(temp, make_shared<Directory>(root)));
+        File* linkFile = arena->create(temp, disk);
+        addFile(linkFile);
+        addToDiskFile(*linkFile, true);
     }
 
-    void Directory::rm(const string &fileToRmPath) {
-        ifstream inputFile("disk.txt");
-        ofstream tempFile("temp.txt");
-
-        bool fileFound = false;
-        bool inContentBlock = false;
-        int skipCounter = 0;
-        string placeholder = "~0~";
-
-        if (!inputFile.is_open() || !tempFile.is_open()) {
-            throw ContentsFileNotFound();
-        }
-
-        // Read the content until reaching the placeholder for the second time
-        string line;
-        while (getline(inputFile, line)) {
-            if (inContentBlock) {
-                // Check for the end of content block
-                if (line == placeholder && skipCounter != 0) {
-                    inContentBlock = false;
-                }
-                skipCounter++;
-                continue;
-            }
-
-            // Create an input string stream to read the type and path values of each line with file information
-            istringstream iss(line);
-            string type, filePath;
-            iss >> type >> filePath;
-
-            if (filePath == fileToRmPath) {
-                if (type == "D") {
-                    throw FileIsDirectory(fileToRmPath);
-                } else {
-                    // Mark file found and skip writing both lines for the file
-                    fileFound = true;
-                    inContentBlock = true;
-                    continue;
-                }
-            }
+    void Directory::hardLink(const File& source, const string& name) {
+        // Directories have one entry each, otherwise the tree could contain itself
+        if (source.getType() == 'D')
+            throw FileIsDirectory(source.getName());
+        // The inode belongs to the image of the source
+        if (source.getParent()->arena != arena)
+            throw CrossMountOperation(source.getName());
+        if (findFile(name))
+            throw DirectoryAlreadyExists(name);
+
+        // Only an entry record is written, the content is shared with the source
+        disk->reserve(recordOverhead);
+        File* entry = arena->createEntry(name, source.getInode(), disk);
+        addFile(entry);
+        addToDiskFile(*entry, false);
+    }
 
-            // Write every file except the one to be removed
-            tempFile << line << '\n';
+    void Directory::move(File* entry, Directory& target, const string& newName) {
+        if (&target == this && entry->getName() == newName)
+            return;
+        if (entry->getType() == 'D' && static_cast<const Directory*>(entry)->mount)
+            throw MountPointBusy(entry->getPath());
+        if (target.arena != arena)
+            throw CrossMountOperation(entry->getName());
+        if (target.findFile(newName))
+            throw DirectoryAlreadyExists(newName);
+
+        // A directory can not be moved into itself or into a directory inside it
+        for (const Directory* dir = &target; dir; dir = dir->getParent()) {
+            if (dir == entry)
+                throw InvalidMove(entry->getName());
         }
 
-        inputFile.close();
-        tempFile.close();
-
-        // Make the temp file the new disk file
-        remove("disk.txt");
-        rename("temp.txt", "disk.txt");
-
-        if(fileFound) {
-            // Remove the file from the files vector of the currentDirectory
-            for(auto it = files.begin() ; it != files.end() ; it++) {
-                if((*it)->getType() != 'D' && ((*it)->getPath() == fileToRmPath)) {
-                    removeFile(it);
-                    break;
-                }
-            }
-        } else {
-            // File was not found inside the disk
-            throw PathNotFound(fileToRmPath);
-        }
+        // The new entry record is queued before the old one is removed, an interrupted move leaves two entries
+        // instead of none
+        string oldKey = entryKey(inode->number, entry->getName());
+        detachFile(entry);
+        entry->name = newName;
+        target.addFile(entry);
+        target.addToDiskFile(*entry, false);
+        disk->removeRecords({ oldKey });
     }
 
-    void Directory::rmdir(const string &fileToRmPath) {
-        ifstream inputFile("disk.txt");
-        ofstream tempFile("temp.txt");
-
-        bool fileFound = false;
-        bool inContentBlock = false;
-        int skipCounter = 0;
-        string placeholder = "~0~";
-
-        if (!inputFile.is_open() || !tempFile.is_open()) {
-            throw ContentsFileNotFound();
+    void Directory::rm(const vector<File*>& entries) {
+        // Check every entry in the currentDirectory before touching the disk
+        for (const File* entry : entries) {
+            if (entry->getParent() != this)
+                throw PathNotFound(entry->getPath());
+            if (entry->getType() == 'D')
+                throw FileIsDirectory(entry->getPath());
         }
 
-        string line;
-        while (getline(inputFile, line)) {
-            if (inContentBlock) {
-                // Check for the end of content block
-                if (line == placeholder && skipCounter != 0) {
-                    inContentBlock = false;
-                }
-                skipCounter++;
-                continue;
-            }
-
-            // Create an input string stream to read the type and path values of each line with file information
-            istringstream iss(line);
-            string type, filePath;
-            iss >> type >> filePath;
-
-            if (filePath == fileToRmPath) {
-                if (type == "D") {
-                    // Mark file found and skip writing both lines for the file
-                    fileFound = true;
-                    inContentBlock = true;
-                    continue;
-                } else {
-                    throw NotDirectory(fileToRmPath);
-                }
-            }
+        // Rewrite the disk without the records of the files, then remove them from the files vector
+        removeEntries(entries);
+    }
 
-            // Write every file except the one to be removed
-            tempFile << line << '\n';
+    void Directory::rmdir(const vector<File*>& entries) {
+        // Check every directory in the currentDirectory before touching the disk
+        for (const File* entry : entries) {
+            if (entry->getParent() != this)
+                throw PathNotFound(entry->getPath());
+            if (entry->getType() != 'D')
+                throw NotDirectory(entry->getPath());
         }
 
-        inputFile.close();
-        tempFile.close();
-
-        // Make the temp file the new disk file
-        remove("disk.txt");
-        rename("temp.txt", "disk.txt");
-
-        if(fileFound) {
-            // Remove the file from the files vector of the currentDirectory
-            for(auto it = files.begin() ; it != files.end() ; it++) {
-                if((*it)->getType() == 'D' && ((*it)->getPath() == fileToRmPath)) {
-                    removeFile(it);
-                    break;
-                }
-            }
-        } else {
-            // File was not found inside the disk
-            throw PathNotFound(fileToRmPath);
-        }
+        // Rewrite the disk without the records of the directories and everything inside them
+        removeEntries(entries);
     }
 
     void Directory::cp(const string& path) {
@@ -518,64 +763,53 @@ namespace GTUShell {
                 // Save that file's content
                 temp.content += (line + "\n");
             }
-            // Remove the last \n
-            temp.content.erase(temp.content.size()-1);
+            // Remove the last \n, an empty host file has none
+            if (!temp.content.empty())
+                temp.content.pop_back();
             temp.type = 'F';
-
-            string pathValue;
-            string currentPath = getPath();
-            // Add a / if needed
-            if(currentPath.back() == '/') pathValue = currentPath + temp.name;
-            else pathValue = currentPath + "/" + temp.name;
-            temp.path = pathValue;
             temp.size = (temp.content).size();
+            disk->reserve(2 * recordOverhead + temp.content.size());
 
             // Add the newly copied file into the disk and memory
             setTimeToNow(temp);
-            addToDiskFile(temp);
-            auto filePtr = make_shared<RegularFile>(temp);
-            addFile(filePtr);
+            File* file = arena->create(std::move(temp), disk);
+            addFile(file);
+            addToDiskFile(*file, true);
         } else {
             // Look for the file in the currentDirectory
-            string newName;
-            string newContent;
-            string newPath;
-            char newType;
-            int newSize;
-            bool executedFlag = false;
+            const File* source = nullptr;
             for(const auto& filePtr : getFiles()) {
                 if(filePtr->getName() == path) {
-                    newName = filePtr->getName();
-                    newPath = filePtr->getPath();
-                    newContent = filePtr->getContent();
-                    newType = filePtr->getType();
-                    newSize = filePtr->getSize();
-                    executedFlag = true;
+                    source = filePtr;
                     break;
                 }
             }
-            if(executedFlag) {
-                if(newType == 'D')
-                    throw FileIsDirectory(newName);
+            if(source) {
+                if(source->getType() == 'D')
+                    throw FileIsDirectory(source->getName());
 
+                // Compressed contents are copied as they are, without decompressing them, unless something
+                // was appended to them
+                const Inode& sourceInode = *source->getInode();
                 FileData newFile;
-                newFile.name = "copy_" + newName;
-                newFile.content = newContent;
+                newFile.name = "copy_" + source->getName();
                 newFile.type = 'F';
-                newFile.size = newSize;
-                newFile.path = newPath;
-
-                string currentPath = getPath();
-                if(currentPath.back() == '/') newFile.path = currentPath + newFile.name;
-                else newFile.path = currentPath + "/" + newFile.name;
-
-                newFile.size = (newFile.content).size();
+                newFile.size = source->getSize();
+                newFile.compressed = source->isCompressed() && sourceInode.appended().empty();
+                if (sourceInode.appended().empty())
+                    newFile.content = sourceInode.content;
+                else
+                    newFile.content.assign(source->begin(), source->end());
+
+                if (!newFile.compressed)
+                    newFile.size = (newFile.content).size();
+                disk->reserve(2 * recordOverhead + newFile.content.size());
                 setTimeToNow(newFile);
 
                 // Add the new file into the disk and the memory
-                addToDiskFile(newFile);
-                shared_ptr<File> sharedFilePtr = make_shared<RegularFile>(newFile);
-                addFile(sharedFilePtr);
+                File* file = arena->create(std::move(newFile), disk);
+                addFile(file);
+                addToDiskFile(*file, true);
             } else {
                 throw PathNotFound(path);
             }
@@ -583,4 +817,382 @@ namespace GTUShell {
 
     }
 
-}
\ No newline at end of file
+    void Directory::writeFile(const string& name, const string& content, bool append) {
+        File* existing = findFile(name);
+        if (existing && existing->getType() == 'D')
+            throw FileIsDirectory(name);
+
+        // Contents are stored without the last \n, like the files copied with cp
+        string added = content;
+        if (!added.empty() && added.back() == '\n')
+            added.pop_back();
+
+        disk->reserve(2 * recordOverhead + added.size());
+
+        if (existing && existing->getType() == 'F') {
+            // The inode is changed in place, so every hard link of the file sees the new content
+            Inode* fileInode = existing->getInode();
+            fileInode->time = Timestamp::now();
+
+            if (append) {
+                string delta = (fileInode->size > 0 && !added.empty()) ? "\n" + added : added;
+                fileInode->append(delta);
+                fileInode->appendRecords++;
+
+                // Only the delta is written, until the deltas outgrow the base. Then they are folded into a new
+                // inode record, so the cost of the rewrite is spread over at least as many appended bytes.
+                size_t deltaBytes = fileInode->appended().size() + fileInode->appendRecords * recordOverhead;
+                size_t baseBytes = fileInode->content.size();
+                if (deltaBytes < std::max(baseBytes, foldSize)) {
+                    disk->append({ 'A', name, inodeKey(fileInode->number), Timestamp::format(fileInode->time),
+                                   static_cast<int>(delta.size()), delta });
+                    return;
+                }
+                fileInode->fold();
+            } else {
+                fileInode->setContent(added);
+            }
+
+            // The new inode record replaces the old one and its deltas on the disk
+            disk->removeRecords({ inodeKey(fileInode->number) });
+            disk->append({ 'F', name, inodeKey(fileInode->number), Timestamp::format(fileInode->time),
+                           fileInode->size, fileInode->content });
+            return;
+        }
+
+        // A soft link with the name is replaced by a regular file
+        if (existing)
+            removeEntries({ existing });
+
+        FileData newFile = { 'F', name, "", "0", static_cast<int>(added.size()), added };
+        setTimeToNow(newFile);
+        File* file = arena->create(std::move(newFile), disk);
+        addFile(file);
+        addToDiskFile(*file, true);
+    }
+
+    uint64_t Directory::prepareWrite(const string& name, bool append) {
+        // A regular file that is appended to stays as it is, a soft link with the name is replaced like in writeFile
+        File* existing = findFile(name);
+        if (!existing || existing->getType() != 'F' || !append)
+            writeFile(name, "", false);
+        return findFile(name)->getInode()->number;
+    }
+
+    void Directory::appendChunks(const string& name, uint64_t number, vector<string>& chunks) {
+        File* file = findFile(name);
+        if (!file || file->getType() != 'F' || file->getInode()->number != number)
+            return;
+
+        // Contents are stored without the last \n, the output is joined to old content with one
+        while (!chunks.empty() && chunks.back().empty())
+            chunks.pop_back();
+        if (!chunks.empty() && chunks.back().back() == '\n')
+            chunks.back().pop_back();
+
+        size_t bytes = 0;
+        for (const string& chunk : chunks)
+            bytes += chunk.size() + recordOverhead;
+        disk->reserve(bytes);
+
+        Inode* fileInode = file->getInode();
+        fileInode->time = Timestamp::now();
+        string date = Timestamp::format(fileInode->time);
+        bool first = true;
+        for (string& chunk : chunks) {
+            if (chunk.empty())
+                continue;
+            if (first && fileInode->size > 0)
+                chunk.insert(0, "\n");
+            first = false;
+
+            fileInode->append(chunk);
+            fileInode->appendRecords++;
+            int size = static_cast<int>(chunk.size());
+            disk->append({ 'A', name, inodeKey(number), date, size, std::move(chunk) });
+        }
+    }
+
+    void Directory::importTree(std::ostream& out, const string& hostDir, const string& targetName) {
+        if (findFile(targetName))
+            throw DirectoryAlreadyExists(targetName);
+        HostTree tree = readHostTree(hostDir);
+        addHostTree(out, tree, targetName);
+    }
+
+    Directory::HostTree Directory::readHostTree(const string& hostDir) {
+        namespace fs = std::filesystem;
+        HostTree tree;
+        tree.start = std::chrono::steady_clock::now();
+
+        std::error_code error;
+        if (!fs::is_directory(hostDir, error))
+            throw PathNotFound(hostDir);
+
+        // Names with tabs or newlines can not be stored in the header of a record
+        auto storable = [](const string& name) { return name.find_first_of("\t\n") == string::npos; };
+
+        // Walk the host tree first, parents are always found before their children
+        std::ostringstream messages;
+        fs::recursive_directory_iterator it(hostDir, fs::directory_options::skip_permission_denied, error);
+        for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+            JobControl::checkKilled();
+            // Entries that can not be inspected are skipped without stopping the walk
+            std::error_code entryError;
+            string relative = it->path().lexically_relative(hostDir).generic_string();
+            bool isDirectory = it->is_directory(entryError) && !it->is_symlink(entryError);
+            if (!storable(relative)) {
+                messages << "Skipped " << it->path().string() << ": the name can not be stored\n";
+                if (isDirectory)
+                    it.disable_recursion_pending();
+                tree.skipped++;
+            } else if (isDirectory) {
+                tree.directoryPaths.push_back(relative);
+            } else if (it->is_regular_file(entryError)) {
+                tree.filePaths.push_back(relative);
+                tree.hostFiles.push_back(it->path().string());
+            }
+        }
+        if (error)
+            messages << "Stopped reading " << hostDir << ": " << error.message() << "\n";
+        tree.messages = messages.str();
+
+        // Read the files in parallel, in blocks so that binary contents are copied as they are.
+        // Reading waits on the host disk, so there are more readers than cores.
+        const vector<string>& hostFiles = tree.hostFiles;
+        tree.contents.resize(hostFiles.size());
+        tree.failed.resize(hostFiles.size(), 0);
+        std::atomic<size_t> nextFile{0};
+        const std::atomic<bool>* killFlag = JobControl::flag();
+        auto readFiles = [&] {
+            JobControl::setFlag(killFlag);
+            vector<char> block(1024 * 1024);
+            for (size_t i = nextFile++; i < hostFiles.size() && !JobControl::killed(); i = nextFile++) {
+                ifstream input(hostFiles[i], std::ios::binary);
+                while (input.read(block.data(), block.size()) || input.gcount() > 0)
+                    tree.contents[i].append(block.data(), input.gcount());
+                tree.failed[i] = !input.eof() || input.bad();
+            }
+        };
+
+        size_t threadCount = std::min<size_t>(hostFiles.size(), std::max(4u, std::thread::hardware_concurrency()));
+        vector<std::thread> readers;
+        for (size_t i = 1; i < threadCount; i++)
+            readers.emplace_back(readFiles);
+        readFiles();
+        for (auto& reader : readers)
+            reader.join();
+        JobControl::checkKilled();
+        return tree;
+    }
+
+    void Directory::addHostTree(std::ostream& out, HostTree& tree, const string& targetName) {
+        if (findFile(targetName))
+            throw DirectoryAlreadyExists(targetName);
+        size_t treeBytes = (tree.directoryPaths.size() + 1) * 2 * recordOverhead;
+        for (const string& content : tree.contents)
+            treeBytes += content.size() + 2 * recordOverhead;
+        disk->reserve(treeBytes);
+        out << tree.messages;
+        const vector<string>& directoryPaths = tree.directoryPaths;
+        const vector<string>& filePaths = tree.filePaths;
+        size_t skipped = tree.skipped;
+
+        // Build the subtree first, the records refer to the numbers of its inodes. Directories come first, so
+        // every parent exists before its children.
+        FileData stamp;
+        setTimeToNow(stamp);
+        vector<FileData> batch;
+        auto target = static_cast<Directory*>(arena->create({ 'D', targetName, "", stamp.date, 0, "" }, disk));
+        addFile(target);
+        addRecords(*target, true, batch);
+
+        unordered_map<string, Directory*> directories;
+        auto parentOf = [&](const string& relative) {
+            size_t lastSlash = relative.find_last_of('/');
+            return lastSlash == string::npos ? target : directories.at(relative.substr(0, lastSlash));
+        };
+        for (const auto& relative : directoryPaths) {
+            File* dir = arena->create({ 'D', relative.substr(relative.find_last_of('/') + 1), "", stamp.date, 0, "" },
+                                      disk);
+            parentOf(relative)->addFile(dir);
+            directories[relative] = static_cast<Directory*>(dir);
+            addRecords(*dir, true, batch);
+        }
+
+        // The contents are moved into the records and from there into the inodes, they are never copied
+        vector<std::pair<Inode*, size_t> > contentRecords;
+        size_t bytes = 0;
+        size_t fileCount = 0;
+        for (size_t i = 0; i < filePaths.size(); i++) {
+            if (tree.failed[i]) {
+                out << "Could not read " << tree.hostFiles[i] << "\n";
+                skipped++;
+                continue;
+            }
+            const string& relative = filePaths[i];
+            string& content = tree.contents[i];
+            bytes += content.size();
+            fileCount++;
+            File* file = arena->create({ 'F', relative.substr(relative.find_last_of('/') + 1), "", stamp.date,
+                                         static_cast<int>(content.size()), "" }, disk);
+            parentOf(relative)->addFile(file);
+            contentRecords.emplace_back(file->getInode(), batch.size());
+            addRecords(*file, true, batch);
+            batch[contentRecords.back().second].content = std::move(content);
+        }
+        disk->append(batch);
+        for (const auto& contentRecord : contentRecords)
+            contentRecord.first->content = std::move(batch[contentRecord.second].content);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tree.start).count();
+        double megabytes = bytes / (1024.0 * 1024.0);
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2) << "Imported " << fileCount << " files and "
+               << directoryPaths.size() << " directories (" << megabytes << " MB) in " << seconds << " s: "
+               << fileCount / seconds << " files/s, " << megabytes / seconds << " MB/s";
+        if (skipped > 0)
+            report << ", " << skipped << " skipped";
+        out << report.str() << "\n";
+    }
+
+    void Directory::exportTree(std::ostream& out, const File& node, const string& hostPath, bool copyLinks) {
+        namespace fs = std::filesystem;
+        auto start = std::chrono::steady_clock::now();
+
+        // A host file and the inode whose content goes into it
+        struct FileJob {
+            string hostPath;
+            const Inode* inode;
+        };
+
+        // Collect everything first, directories are created before any file is written
+        string exportedPath = node.getPath();
+        string exportedPrefix = (exportedPath == "/") ? "/" : exportedPath + "/";
+        vector<string> hostDirectories;
+        vector<FileJob> jobs;
+        vector<std::pair<string, string> > symlinks;
+        vector<string> messages;
+
+        std::function<void(const File&, const string&)> collect = [&](const File& file, const string& filePath) {
+            switch (file.getType()) {
+                case 'D': {
+                    JobControl::checkKilled();
+                    hostDirectories.push_back(filePath);
+                    for (const File* child : static_cast<const Directory&>(file).getFiles()) {
+                        // The "." entry of the root is the root itself
+                        if (child->getInode() != file.getInode())
+                            collect(*child, filePath + "/" + child->getName());
+                    }
+                    break;
+                }
+                case 'S': {
+                    const string& targetPath = file.getContent();
+                    if (!copyLinks && targetPath.compare(0, exportedPrefix.size(), exportedPrefix) == 0) {
+                        // The target is exported too, link to where it is written relative to the link
+                        fs::path targetHost = fs::path(hostPath) / targetPath.substr(exportedPrefix.size());
+                        symlinks.emplace_back(filePath, targetHost.lexically_relative(fs::path(filePath).parent_path()).string());
+                    } else if (const Inode* target = static_cast<const SoftLinkedFile&>(file).target()) {
+                        jobs.push_back({ filePath, target });
+                    } else {
+                        messages.push_back("Skipped " + file.getPath() + ": " + targetPath + " was not found");
+                    }
+                    break;
+                }
+                default:
+                    jobs.push_back({ filePath, file.getInode() });
+                    break;
+            }
+        };
+        collect(node, hostPath);
+
+        // The host directory that holds the exported node is created too
+        string parentPath = fs::path(hostPath).parent_path().string();
+        if (!parentPath.empty())
+            hostDirectories.insert(hostDirectories.begin(), parentPath);
+
+        for (const auto& dirPath : hostDirectories) {
+            std::error_code error;
+            fs::create_directories(dirPath, error);
+            if (error) {
+                out << DiskWriteFailed(dirPath, error.message()).what() << "\n";
+                return;
+            }
+        }
+
+        // Every file is written straight from the content in memory with one write call per chunk of the kernel.
+        // Writing waits on the host disk, so there are more writers than cores.
+        vector<string> errors(jobs.size());
+        std::atomic<size_t> nextJob{0};
+        std::atomic<size_t> bytes{0};
+        const std::atomic<bool>* killFlag = JobControl::flag();
+        auto writeFiles = [&] {
+            JobControl::setFlag(killFlag);
+            for (size_t i = nextJob++; i < jobs.size() && !JobControl::killed(); i = nextJob++) {
+                int fd = open(jobs[i].hostPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    errors[i] = DiskWriteFailed(jobs[i].hostPath, strerror(errno)).what();
+                    continue;
+                }
+
+                // The base and the appended bytes are written one after the other
+                for (const string* piece : { &jobs[i].inode->readableBase(), &jobs[i].inode->appended() }) {
+                    const char* data = piece->data();
+                    size_t remaining = piece->size();
+                    while (remaining > 0) {
+                        ssize_t written = write(fd, data, remaining);
+                        if (written < 0 && errno == EINTR)
+                            continue;
+                        if (written < 0) {
+                            errors[i] = DiskWriteFailed(jobs[i].hostPath, strerror(errno)).what();
+                            break;
+                        }
+                        data += written;
+                        remaining -= written;
+                    }
+                    bytes += piece->size() - remaining;
+                    if (remaining > 0)
+                        break;
+                }
+                close(fd);
+            }
+        };
+
+        size_t threadCount = std::min<size_t>(jobs.size(), std::max(4u, std::thread::hardware_concurrency()));
+        vector<std::thread> writers;
+        for (size_t i = 1; i < threadCount; i++)
+            writers.emplace_back(writeFiles);
+        writeFiles();
+        for (auto& writer : writers)
+            writer.join();
+        JobControl::checkKilled();
+
+        for (const auto& link : symlinks) {
+            std::error_code error;
+            fs::remove(link.first, error);
+            fs::create_symlink(link.second, link.first, error);
+            if (error)
+                messages.push_back(DiskWriteFailed(link.first, error.message()).what());
+        }
+
+        size_t directoryCount = hostDirectories.size() - (parentPath.empty() ? 0 : 1);
+        size_t fileCount = jobs.size();
+        for (const auto& error : errors) {
+            if (!error.empty()) {
+                messages.push_back(error);
+                fileCount--;
+            }
+        }
+        for (const auto& message : messages)
+            out << message << "\n";
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double megabytes = bytes / (1024.0 * 1024.0);
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2) << "Exported " << fileCount << " files, " << symlinks.size()
+               << " links and " << directoryCount << " directories (" << megabytes << " MB) in "
+               << seconds << " s: " << fileCount / seconds << " files/s, " << megabytes / seconds << " MB/s";
+        out << report.str() << "\n";
+    }
+
+}
@@ -1,49 +1,212 @@
 #ifndef DIRECTORY_H
 #define DIRECTORY_H
 #include "File.h"
+#include "DiskImage.h"
+#include "NodeArena.h"
+#include <chrono>
 #include <map>
+#include <unordered_map>
 
 namespace GTUShell {
+    class Mount;
+    class OutputBuffer;
+
     class Directory : public File {
     public:
+        // Output of ls: aligned columns, a JSON array of objects, or names (paths with -R) ended by a NUL byte
+        enum class ListFormat { text, json, nul };
+
+        // Order of ls: the order the children were added in, by name, or by size or date (largest and newest first,
+        // ties by name)
+        enum class ListOrder { added, name, size, time };
+
+        // Directories and files read from a host directory, before they are added to a tree
+        struct HostTree {
+            vector<string> directoryPaths;
+            vector<string> filePaths;
+            vector<string> hostFiles;
+            vector<string> contents;
+            vector<char> failed;
+            size_t skipped = 0;
+            // Names that were skipped while walking the host directory
+            string messages;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        struct ListOptions {
+            ListFormat format = ListFormat::text;
+            ListOrder order = ListOrder::added;
+            // The page: rows offset to offset + limit of the order, after the child named after if it is set
+            size_t offset = 0;
+            size_t limit = SIZE_MAX;
+            string after;
+        };
+
         Directory() = default;
 
+        // Children are owned by the arena, a directory is never copied
+        Directory(const Directory&) = delete;
+        Directory& operator=(const Directory&) = delete;
+
         // Iterator overrides
         iterator begin() const override;
         iterator end() const override;
 
+        // Writes the same bytes as the iterators, one child at a time instead of one byte at a time
+        void cat(std::ostream& out) const override;
+
         // Getter function for the files vector
-        vector<shared_ptr<File> > getFiles() const;
+        const vector<File*>& getFiles() const;
 
         // Function for managing the file system
-        static void cd(string& currentPath, const Directory& root, Directory& currentDirectory, const string& newDir);
-        void rm(const string& filepath);
-        void rmdir(const string& filepath);
-        void ls(string currentPath, const Directory& dir, const Directory& root) const;
-        void lsRecursive(const Directory& dir) const;
-        void mkdir(const string& name, const string& path);
-        void link(const string& sourceFile, const string& targetName, const Directory& root);
+        // Returns the directory to change to, nullptr if the directory does not change
+        static Directory* cd(const Directory& currentDirectory, const string& newDir, std::ostream& errors);
+        // Remove every given child with one rewrite of the disk, nothing is removed if one of them is not valid
+        void rm(const vector<File*>& entries);
+        void rmdir(const vector<File*>& entries);
+        // Listings are formatted into an OutputBuffer and written in large blocks. A page of the name order is read
+        // from filesByName, a page of the size or date order only sorts the rows up to its end (a partial sort).
+        void ls(std::ostream& out, const ListOptions& options, std::ostream& errors) const;
+        void lsRecursive(std::ostream& out, ListFormat format = ListFormat::text) const;
+        void mkdir(const string& name);
+        void link(std::ostream& errors, const string& sourceFile, const string& targetName);
         void cp(const string& sourcePath);
 
-        //Adder/remover functions for the files vector
-        void addFile(const shared_ptr<File>& file);
-        void removeFile(const vector<shared_ptr<File>>::iterator& it);
+        // Adds an entry with the name that refers to the inode of the source (a hard link)
+        void hardLink(const File& source, const string& name);
+
+        // Moves the child to the target directory under the new name. Only the entry changes, the inode and the
+        // entries inside a moved directory are not touched.
+        void move(File* entry, Directory& target, const string& newName);
+
+        // Copies the host directory and everything inside it into a new child directory with the given name.
+        // Host files are read by several threads, and all records are queued with one batch.
+        void importTree(std::ostream& out, const string& hostDir, const string& targetName);
+
+        // The two steps of importTree. Reading does not touch any tree, so it can run before the tree is locked.
+        static HostTree readHostTree(const string& hostDir);
+        void addHostTree(std::ostream& out, HostTree& tree, const string& targetName);
+
+        // Writes the node and everything inside it to the host path. Soft links whose target is exported too become
+        // relative symlinks, other soft links (and every soft link when copyLinks is set) become copies of their target.
+        // Files are written by several threads.
+        static void exportTree(std::ostream& out, const File& node, const string& hostPath, bool copyLinks);
+
+        // Creates or replaces the regular file with the given name, the content is added to the end of the
+        // old content when append is true. An append only writes an append record with the new bytes.
+        void writeFile(const string& name, const string& content, bool append);
+
+        // The two ends of a redirection. prepareWrite creates the regular file or empties it unless append is set,
+        // and returns the number of its inode. appendChunks adds the output to the end of it like writeFile, with
+        // one append record per chunk. Nothing is added if the file was removed or replaced in between.
+        uint64_t prepareWrite(const string& name, bool append);
+        void appendChunks(const string& name, uint64_t number, vector<string>& chunks);
+
+        //Adder function for the files vector
+        void addFile(File* file);
+
+        // Takes the root of a mount out of the directory, the mount owns it
+        void detachMount(Directory& mountRoot);
+
+        // Finds the child directory with the given name, nullptr if there is none
+        Directory* findDirectory(const string& name) const;
+
+        // Finds the first child with the given name, nullptr if there is none
+        File* findFile(const string& name) const;
+
+        // Finds the node of a path that starts at this directory ("/a/b"), this directory itself for "/"
+        File* findPath(const string& path) const;
+
+        // Returns the children whose names match the glob pattern (*, ? and [...]) sorted by name.
+        // Names that start with a dot only match patterns that start with a dot.
+        vector<File*> glob(const string& pattern) const;
 
-        // Reads the contents of the disk
-        void readDiskFile();
+        // True if the word contains a glob character
+        static bool isGlob(const string& word);
 
-        // Adds to the contents file if a file is created/updated
-        static void addToDiskFile(const FileData& data);
+        // Reads the contents of the disk. Disks that store one record per path are converted to inode records.
+        // Damaged records that are skipped are reported to messages.
+        void readDiskFile(std::ostream& messages);
+
+        // Record keys: an inode is stored as "#number", an entry as "#directory number/name" with the number of its
+        // inode as content
+        static string inodeKey(uint64_t number);
+        static string entryKey(uint64_t directoryNumber, const string& name);
+
+        // The record of the inode of an empty root directory
+        static FileData rootRecord();
+
+        // Setter and getter for the disk that stores this directory and the directories inside it
+        void setDisk(const shared_ptr<DiskImage>& diskVal);
+        shared_ptr<DiskImage> getDisk() const;
+
+        // Setter and getter for the arena that owns the children of this directory
+        void setArena(NodeArena* arenaVal);
+        NodeArena* getArena() const;
+
+        // Setter and getter for the mount whose root this directory is, nullptr for every other directory
+        void setMount(Mount* mountVal);
+        Mount* getMount() const;
 
     private:
-        vector<shared_ptr<File> > files;
+        vector<File*> files;
+        shared_ptr<DiskImage> disk;
+        NodeArena* arena = nullptr;
+        Mount* mount = nullptr;
+
+        // The children sorted by name, so lookups and globs with a literal prefix do not scan every child
+        std::multimap<string, File*> filesByName;
+
+        // Removes the records of the children and of the inodes that lose their last link, then removes the
+        // children from files and filesByName and releases them
+        void removeEntries(const vector<File*>& entries);
+
+        // Collects the children of the page of the listing, false if the child named after does not exist
+        bool selectPage(const ListOptions& options, vector<const File*>& page, std::ostream& errors) const;
+
+        // Adds a row for every child and everything inside it, path holds the path of this directory ("" for the
+        // root) and is extended in place for every child
+        void listTree(OutputBuffer& buffer, ListFormat format, string& path, bool& first) const;
+
+        // Removes the child from files and filesByName without releasing it
+        void detachFile(File* file);
+
+        // Invalidates the iterators of this directory and the paths resolved in its arena
+        void childrenChanged();
+
+        // The image of a mount point is read the first time its children are used
+        void ensureLoaded() const {
+            if (mount)
+                loadMount();
+        }
+        void loadMount() const;
+
+        // Adds the keys of the entry (and of everything inside it) to keys, and counts the links of every inode
+        static void collectKeys(const File& entry, std::unordered_map<const Inode*, uint32_t>& removedLinks,
+                                vector<string>& keys);
+
+        // Adds the records of the entry to the batch, and the record of its inode when withInode is set
+        static void addRecords(const File& entry, bool withInode, vector<FileData>& batch);
+
+        // Queues the records of the entry
+        void addToDiskFile(const File& entry, bool withInode) const;
+
+        // Builds the tree from one record per path, the way older disks are stored
+        void loadPaths(vector<FileData>& records);
+
+        // Builds the tree from inode and entry records
+        void loadInodes(vector<FileData>& records);
 
         static void setTimeToNow(FileData& data);
 
-        // This string is marked mutable because the iterator (const function) needs to be able to modify it
-        mutable string filesAsString;
-        // Receives file information from the files vector and turns it into a string for the iterator
-        void updateFilesAsString() const;
+        // Appended bytes are folded into a new inode record once they (and the headers of their records) take
+        // more space than the base, and at least foldSize
+        static constexpr size_t foldSize = 1024 * 1024;
+        // About the size of the header of a record, also counted for every record a change reserves on the disk
+        static constexpr size_t recordOverhead = 64;
+
+        // Changed on every modification of the children, so iterators can detect that they are not valid anymore
+        uint64_t version = 0;
     };
 } //GTUShell namespace
 
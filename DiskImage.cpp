@@ -0,0 +1,938 @@
+#include "DiskImage.h"
+#include "LzCodec.h"
+#include "RecordScanner.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace GTUShell {
+
+    namespace {
+        const string placeholder = "~0~";
+
+        // A header has 7 fields, or 8 with the encoding
+        const size_t maxHeaderTabs = 7;
+
+        // Bytes checkImage reads from the start of an image, enough for the type and the tabs of the first header
+        const size_t headerCheckSize = 4096;
+
+        // Parses the digits of a header field, value is 0 when there are none
+        template <typename T>
+        T parseNumber(const char* begin, const char* end, int base = 10) {
+            T value = 0;
+            std::from_chars(begin, end, value, base);
+            return value;
+        }
+
+        // Writes all of the bytes to the descriptor, name is only used for the error message
+        void writeFully(int fd, const string& bytes, const string& name) {
+            const char* data = bytes.data();
+            size_t remaining = bytes.size();
+            while (remaining > 0) {
+                ssize_t written = write(fd, data, remaining);
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw DiskWriteFailed(name, strerror(errno));
+                }
+                data += written;
+                remaining -= written;
+            }
+        }
+
+        // True if a header of an older record, 5 fields and a known type, starts at pos and a placeholder follows it
+        bool startsOlderRecord(const string& buffer, size_t pos) {
+            if (pos + 2 > buffer.size() || !memchr("FSDEA", buffer[pos], 5) || buffer[pos + 1] != '\t')
+                return false;
+            size_t lineEnd = buffer.find('\n', pos);
+            if (lineEnd == string::npos || count(buffer.begin() + pos, buffer.begin() + lineEnd, '\t') != 4)
+                return false;
+            return buffer.compare(lineEnd + 1, placeholder.size() + 1, placeholder + "\n") == 0;
+        }
+
+        // Reads the whole file with one read into a buffer of its size
+        string readFile(const string& filePath) {
+            int fd = open(filePath.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw ContentsFileNotFound();
+
+            struct stat status;
+            string bytes;
+            if (fstat(fd, &status) == 0)
+                bytes.resize(static_cast<size_t>(status.st_size));
+            size_t filled = 0;
+            while (filled < bytes.size()) {
+                ssize_t count = read(fd, &bytes[filled], bytes.size() - filled);
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count <= 0)
+                    break;
+                filled += static_cast<size_t>(count);
+            }
+            bytes.resize(filled);
+
+            // Bytes written after fstat are read too
+            char block[64 * 1024];
+            while (true) {
+                ssize_t count = read(fd, block, sizeof(block));
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count <= 0)
+                    break;
+                bytes.append(block, static_cast<size_t>(count));
+            }
+            close(fd);
+            return bytes;
+        }
+
+        // Returns the directory part of a file path, "." if it has none
+        string directoryOf(const string& filePath) {
+            size_t lastSlash = filePath.find_last_of('/');
+            if (lastSlash == string::npos)
+                return ".";
+            return lastSlash == 0 ? "/" : filePath.substr(0, lastSlash);
+        }
+    }
+
+    DiskImage::DiskImage(string pathVal) : path(std::move(pathVal)) {
+        writer = thread(&DiskImage::runWriter, this);
+    }
+
+    DiskImage::~DiskImage() {
+        // The writer finishes the queued operations before it stops
+        {
+            lock_guard<mutex> lock(diskMutex);
+            stopping = true;
+        }
+        workAvailable.notify_one();
+        writer.join();
+
+        if (writerError)
+            cout << "Some changes could not be written to " << path << "\n";
+        for (auto& segment : segments) {
+            if (segment.second.appendFd >= 0)
+                close(segment.second.appendFd);
+        }
+    }
+
+    const string& DiskImage::getPath() const {
+        return path;
+    }
+
+    void DiskImage::setQuota(size_t maxBytesVal, QuotaMode quotaModeVal) {
+        maxBytes = maxBytesVal;
+        quotaMode = quotaModeVal;
+    }
+
+    size_t DiskImage::getQuota() const {
+        return maxBytes;
+    }
+
+    DiskImage::QuotaMode DiskImage::getQuotaMode() const {
+        return quotaMode;
+    }
+
+    size_t DiskImage::physicalSize() const {
+        return physicalBytes;
+    }
+
+    size_t DiskImage::logicalSize() const {
+        return logicalBytes;
+    }
+
+    void DiskImage::checkDiskSize() const {
+        TraceSpan span("checkDiskSize");
+        size_t used = quotaMode == QuotaMode::physical ? physicalSize() : logicalSize();
+        span.count(used, 0);
+        if (used > maxBytes)
+            throw DiskExceedsLimit(describeQuota());
+    }
+
+    void DiskImage::reserve(size_t bytes) const {
+        size_t used = quotaMode == QuotaMode::physical ? physicalSize() : logicalSize();
+        if (used + bytes > maxBytes)
+            throw DiskQuotaExceeded(describeQuota());
+    }
+
+    string DiskImage::describeQuota() const {
+        ostringstream limit;
+        limit << std::setprecision(4) << maxBytes / (1024.0 * 1024.0) << "MB" << (quotaMode == QuotaMode::logical ? " (logical)" : "")
+              << " of " << path;
+        return limit.str();
+    }
+
+    void DiskImage::setCompression(bool compressionVal) {
+        compression = compressionVal;
+    }
+
+    void DiskImage::setDurable(bool durableVal) {
+        durable = durableVal;
+    }
+
+    void DiskImage::useSettingsOf(const DiskImage& other) {
+        durable = other.durable;
+        compression = other.compression;
+        segmentSize = other.segmentSize;
+        maxBytes = other.maxBytes;
+        quotaMode = other.quotaMode;
+    }
+
+    bool DiskImage::isDurable() const {
+        return durable;
+    }
+
+    bool DiskImage::usesCompression() const {
+        return compression;
+    }
+
+    size_t DiskImage::getSegmentSize() const {
+        return segmentSize;
+    }
+
+    uint32_t DiskImage::imageChecksum() const {
+        uint32_t crc = 0;
+        if (access(manifestPath().c_str(), F_OK) == 0) {
+            string manifest = readFile(manifestPath());
+            crc = checksum(manifest.data(), manifest.size(), crc);
+        }
+        for (size_t id : readManifest()) {
+            string segment = readFile(segmentPath(id));
+            crc = checksum(segment.data(), segment.size(), crc);
+        }
+        return crc;
+    }
+
+    void DiskImage::copyImage(const string& destination) const {
+        // The files of the copy are named like the ones of this image
+        auto copyFile = [&](const string& source) {
+            string target = destination + source.substr(path.size());
+            string bytes = readFile(source);
+            int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                throw DiskWriteFailed(target, strerror(errno));
+            writeFully(fd, bytes, target);
+            close(fd);
+        };
+        if (access(manifestPath().c_str(), F_OK) == 0)
+            copyFile(manifestPath());
+        for (size_t id : readManifest())
+            copyFile(segmentPath(id));
+    }
+
+    uint32_t DiskImage::checksum(const char* data, size_t size, uint32_t crc) {
+        // Slicing by 8: tables[k] holds the CRC of a byte followed by k zero bytes, so 8 bytes take 8 lookups that
+        // do not depend on each other
+        static const vector<vector<uint32_t>> tables = [] {
+            vector<vector<uint32_t>> values(8, vector<uint32_t>(256));
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                    value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+                values[0][i] = value;
+            }
+            for (size_t k = 1; k < 8; k++) {
+                for (uint32_t i = 0; i < 256; i++)
+                    values[k][i] = values[0][values[k - 1][i] & 0xFF] ^ (values[k - 1][i] >> 8);
+            }
+            return values;
+        }();
+        const uint32_t* t[8];
+        for (size_t k = 0; k < 8; k++)
+            t[k] = tables[k].data();
+
+        crc = ~crc;
+        size_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; i + 8 <= size; i += 8) {
+            uint32_t low, high;
+            memcpy(&low, data + i, 4);
+            memcpy(&high, data + i + 4, 4);
+            low ^= crc;
+            crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+                ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        }
+#endif
+        for (; i < size; i++)
+            crc = t[0][(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    string DiskImage::formatRecord(const FileData& data) {
+        size_t logical;
+        return formatRecord(data, logical, true);
+    }
+
+    string DiskImage::formatRecord(const FileData& data, size_t& logical, bool compression) {
+        // Compress regular files when it saves at least an eighth of the content, keep the others raw
+        const string* content = &data.content;
+        bool compressed = data.compressed;
+        string compressedContent;
+        if (compression && !compressed && data.type == 'F' && data.content.size() >= minCompressSize
+            && data.content.size() == static_cast<size_t>(data.size)) {
+            compressedContent = LzCodec::compress(data.content);
+            if (compressedContent.size() <= data.content.size() - data.content.size() / 8) {
+                content = &compressedContent;
+                compressed = true;
+            }
+        }
+
+        string header;
+        header += data.type;
+        header += "\t" + data.path + "\t" + data.name + "\t" + data.date + "\t" + to_string(data.size)
+                + "\t" + to_string(content->size());
+        if (compressed)
+            header += "\tlz";
+
+        uint32_t crc = checksum(header.data(), header.size());
+        crc = checksum(content->data(), content->size(), crc);
+
+        char crcText[9];
+        snprintf(crcText, sizeof(crcText), "%08x", crc);
+
+        string record = header + "\t" + crcText + "\n" + placeholder + "\n" + *content + "\n" + placeholder + "\n";
+        logical = record.size() - content->size() + (compressed ? data.size : content->size());
+        return record;
+    }
+
+    size_t DiskImage::logicalLength(const Record& record) {
+        if (!record.data.compressed)
+            return record.length;
+        return record.length - record.data.content.size() + record.data.size;
+    }
+
+    size_t DiskImage::parseRecord(const string& buffer, const string& name, size_t start, Record& record,
+                                   bool checksummedOnly) {
+        const char* data = buffer.data();
+        size_t size = buffer.size();
+        size_t pos = start;
+        size_t tabs[maxHeaderTabs];
+        const size_t damaged = string::npos;
+
+        // A header without its new line is damaged, at the end of the buffer it is a torn write
+        size_t tabCount;
+        size_t lineEnd = RecordScanner::scanLine(data, pos, size, tabs, maxHeaderTabs, tabCount);
+        if (lineEnd == size)
+            return damaged;
+        size_t fieldCount = tabCount + 1;
+        auto fieldBegin = [&](size_t field) { return data + (field == 0 ? start : tabs[field - 1] + 1); };
+        auto fieldEnd = [&](size_t field) { return data + (field < tabCount ? tabs[field] : lineEnd); };
+        auto field = [&](size_t field) {
+            return field < fieldCount ? string(fieldBegin(field), fieldEnd(field)) : string();
+        };
+        pos = lineEnd + 1;
+
+        // A header with more fields than a record has is damaged, so is one with 6 (older records have 5). Older
+        // records can not be checked, they are not taken while looking for the next valid record.
+        if (tabCount > maxHeaderTabs || fieldCount == 6 || (checksummedOnly && fieldCount < 7))
+            return damaged;
+
+        // Check the type to see if it is a type the system knows. The checksum covers the type of newer records,
+        // an unknown one is damage like any other.
+        char type = data[start];
+        if (fieldEnd(0) - fieldBegin(0) != 1 || !memchr("FSDEA", type, 5)) {
+            if (fieldCount >= 7)
+                return damaged;
+            throw FileTypeInvalid(name);
+        }
+
+        FileData& temp = record.data;
+        temp.type = type;
+        temp.path = field(1);
+        temp.name = field(2);
+        temp.date = field(3);
+        temp.size = fieldCount > 4 ? parseNumber<int>(fieldBegin(4), fieldEnd(4)) : 0;
+
+        if (fieldCount >= 7) {
+            // Length and checksum are known, the content is read as raw bytes
+            size_t length = parseNumber<size_t>(fieldBegin(5), fieldEnd(5));
+            if (size - pos < placeholder.size() + 1 || memcmp(data + pos, "~0~\n", 4) != 0)
+                return damaged;
+            pos += placeholder.size() + 1;
+
+            if (size - pos < length + placeholder.size() + 2)
+                return damaged;
+            size_t contentStart = pos;
+            pos += length;
+            if (memcmp(data + pos, "\n~0~\n", 5) != 0)
+                return damaged;
+            pos += placeholder.size() + 2;
+
+            // The checksum covers every header field before it
+            uint32_t crc = checksum(data + start, tabs[tabCount - 1] - start);
+            crc = checksum(data + contentStart, length, crc);
+            if (crc != parseNumber<uint32_t>(fieldBegin(tabCount), fieldEnd(tabCount), 16))
+                return damaged;
+            temp.content.assign(data + contentStart, length);
+
+            // The content stays compressed in memory until it is read
+            if (fieldCount >= 8) {
+                if (fieldEnd(6) - fieldBegin(6) != 2 || memcmp(fieldBegin(6), "lz", 2) != 0 || temp.type != 'F') {
+                    if (checksummedOnly)
+                        return damaged;
+                    throw ContentCorrupted();
+                }
+                temp.compressed = true;
+            }
+        } else {
+            // Older record, the lines after the header are placeholder\ncontent\nplaceholder. Lines before the
+            // first placeholder are skipped and the content ends at the second one, or at the end of the buffer.
+            size_t contentStart = string::npos;
+            size_t contentEnd = size;
+            while (pos < size) {
+                lineEnd = RecordScanner::findNewline(data, pos, size);
+                bool isPlaceholder = lineEnd - pos == placeholder.size()
+                                     && memcmp(data + pos, placeholder.data(), placeholder.size()) == 0;
+                size_t lineStart = pos;
+                pos = min(lineEnd + 1, size);
+                if (!isPlaceholder)
+                    continue;
+                if (contentStart != string::npos) {
+                    contentEnd = lineStart; // Second placeholder is reached, the content is complete
+                    break;
+                }
+                contentStart = pos; // Currently at the first placeholder, the content starts after it
+            }
+
+            if (contentStart != string::npos && contentStart < contentEnd) {
+                // The content is the lines in between without the last new line. Empty lines at its start were
+                // never kept by the line reader, they are still dropped.
+                if (data[contentEnd - 1] == '\n')
+                    contentEnd--;
+                while (contentStart < contentEnd && data[contentStart] == '\n')
+                    contentStart++;
+                temp.content.assign(data + contentStart, contentEnd - contentStart);
+            }
+        }
+
+        record.offset = start;
+        record.length = pos - start;
+        return pos;
+    }
+
+    size_t DiskImage::parseRecords(const string& buffer, const string& name, vector<Record>& records,
+                                   vector<Range>& damagedRanges) {
+        size_t pos = 0;
+        while (pos < buffer.size()) {
+            Record record;
+            size_t end = parseRecord(buffer, name, pos, record, false);
+            if (end != string::npos) {
+                records.push_back(std::move(record));
+                pos = end;
+                continue;
+            }
+
+            // A damaged record is skipped up to the next line that starts a record with a valid checksum. When no
+            // such record follows, the damage is the end of a torn write.
+            size_t next = RecordScanner::findNewline(buffer.data(), pos, buffer.size()) + 1;
+            while (next < buffer.size()) {
+                Record candidate;
+                if (parseRecord(buffer, name, next, candidate, true) != string::npos)
+                    break;
+                next = RecordScanner::findNewline(buffer.data(), next, buffer.size()) + 1;
+            }
+            if (next >= buffer.size()) {
+                // Older records have no checksum to resync to, the disk is not cut short in front of one
+                for (next = RecordScanner::findNewline(buffer.data(), pos, buffer.size()) + 1; next < buffer.size();
+                     next = RecordScanner::findNewline(buffer.data(), next, buffer.size()) + 1) {
+                    if (startsOlderRecord(buffer, next))
+                        throw RecordDamaged(name, pos);
+                }
+                return pos;
+            }
+            damagedRanges.push_back({ pos, next - pos });
+            pos = next;
+        }
+        return pos;
+    }
+
+    string DiskImage::segmentPath(size_t id) const {
+        return id == 0 ? path : path + "." + to_string(id);
+    }
+
+    string DiskImage::manifestPath() const {
+        return path + ".manifest";
+    }
+
+    vector<size_t> DiskImage::readManifest() const {
+        ifstream inputStream(manifestPath());
+        if (!inputStream.is_open())
+            return { 0 }; // A disk without a manifest has a single segment
+
+        vector<size_t> ids;
+        string line;
+        while (getline(inputStream, line)) {
+            if (line.empty())
+                continue;
+            char* end = nullptr;
+            unsigned long id = strtoul(line.c_str(), &end, 10);
+            if (!isdigit(static_cast<unsigned char>(line[0])) || *end != '\0')
+                throw FileTypeInvalid(manifestPath());
+            ids.push_back(id);
+        }
+        return ids;
+    }
+
+    void DiskImage::checkImage() const {
+        vector<size_t> ids = readManifest();
+        for (size_t id : ids) {
+            if (id != 0 && access(segmentPath(id).c_str(), F_OK) != 0)
+                throw SegmentNotFound(segmentPath(id));
+        }
+        if (ids.empty())
+            return;
+
+        // Only the header of the first record is read, it has to start with a type the system knows. A header
+        // that ends without its new line is the end of a torn write, load drops it.
+        string segmentFile = segmentPath(ids.front());
+        ifstream inputStream(segmentFile, ios::binary);
+        char header[headerCheckSize];
+        inputStream.read(header, sizeof(header));
+        size_t length = static_cast<size_t>(inputStream.gcount());
+        if (length == 0)
+            return;
+        size_t tabCount;
+        size_t tabs[maxHeaderTabs];
+        size_t lineEnd = RecordScanner::scanLine(header, 0, length, tabs, maxHeaderTabs, tabCount);
+        size_t typeEnd = tabCount > 0 ? tabs[0] : lineEnd;
+        if (typeEnd != 1 || !memchr("FSDEA", header[0], 5) || tabCount > maxHeaderTabs)
+            throw FileTypeInvalid(segmentFile);
+    }
+
+    void DiskImage::writeFileAtomically(const string& filePath, const string& bytes) const {
+        // Write the new file next to the old one, make it durable and replace the old one in one step
+        string tempPath = filePath + ".tmp";
+        int tempFd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (tempFd < 0)
+            throw DiskWriteFailed(tempPath, strerror(errno));
+
+        try {
+            writeFully(tempFd, bytes, tempPath);
+            if (durable && fsync(tempFd) != 0)
+                throw DiskWriteFailed(tempPath, strerror(errno));
+        } catch (...) {
+            close(tempFd);
+            throw;
+        }
+        close(tempFd);
+
+        if (rename(tempPath.c_str(), filePath.c_str()) != 0)
+            throw DiskWriteFailed(filePath, strerror(errno));
+        syncDirectory();
+    }
+
+    vector<FileData> DiskImage::load(std::ostream& messages) {
+        // Nothing may be waiting for the writer while the segments are replaced
+        sync();
+        TraceSpan span("disk load");
+        lock_guard<mutex> lock(diskMutex);
+
+        vector<size_t> ids = readManifest();
+        vector<vector<Record>> parsed(ids.size());
+        vector<exception_ptr> errors(ids.size());
+        vector<size_t> sizes(ids.size());
+        // The workers only add to the messages of their own segments
+        vector<string> notes(ids.size());
+
+        // Every segment is read and parsed on its own, by as many threads as there are cores
+        atomic<size_t> nextSegment{0};
+        auto parseSegments = [&] {
+            for (size_t i = nextSegment++; i < ids.size(); i = nextSegment++) {
+                try {
+                    string segmentFile = segmentPath(ids[i]);
+                    if (ids[i] != 0 && access(segmentFile.c_str(), F_OK) != 0)
+                        throw SegmentNotFound(segmentFile);
+                    string buffer = readFile(segmentFile);
+                    vector<Range> damagedRanges;
+                    size_t validLength = parseRecords(buffer, segmentFile, parsed[i], damagedRanges);
+
+                    // Damaged records that valid ones follow are skipped but kept in the file, nothing valid is
+                    // ever removed on load
+                    for (const auto& range : damagedRanges) {
+                        notes[i] += "Skipping " + to_string(range.length) + " damaged bytes at offset "
+                                    + to_string(range.offset) + " of " + segmentFile + "\n";
+                    }
+                    if (validLength < buffer.size()) {
+                        // Nothing valid follows: the end of an interrupted write, drop it so new records follow valid ones
+                        notes[i] += "Ignoring " + to_string(buffer.size() - validLength)
+                                    + " damaged bytes at the end of " + segmentFile + "\n";
+                        if (truncate(segmentFile.c_str(), static_cast<off_t>(validLength)) != 0)
+                            throw DiskWriteFailed(segmentFile, strerror(errno));
+                    }
+                    sizes[i] = validLength;
+                } catch (...) {
+                    errors[i] = current_exception();
+                }
+            }
+        };
+
+        size_t threadCount = min<size_t>(ids.size(), max(1u, thread::hardware_concurrency()));
+        vector<thread> workers;
+        for (size_t i = 1; i < threadCount; i++)
+            workers.emplace_back(parseSegments);
+        parseSegments();
+        for (auto& worker : workers)
+            worker.join();
+
+        for (const auto& note : notes)
+            messages << note;
+        for (const auto& error : errors) {
+            if (error)
+                rethrow_exception(error);
+        }
+
+        // Records are returned in segment order, which is the order they were written in
+        for (auto& segment : segments) {
+            if (segment.second.appendFd >= 0)
+                close(segment.second.appendFd);
+        }
+        segments.clear();
+        segmentsOfPath.clear();
+        manifestSegments = set<size_t>(ids.begin(), ids.end());
+        size_t physical = 0;
+        size_t logical = 0;
+
+        size_t recordCount = 0;
+        for (const auto& records : parsed)
+            recordCount += records.size();
+        vector<FileData> result;
+        result.reserve(recordCount);
+        segmentsOfPath.reserve(recordCount);
+        for (size_t i = 0; i < ids.size(); i++) {
+            Segment& segment = segments[ids[i]];
+            segment.size = sizes[i];
+            for (auto& record : parsed[i]) {
+                segment.logical += logicalLength(record);
+                segmentsOfPath.emplace(record.data.path, ids[i]);
+                result.push_back(std::move(record.data));
+            }
+            physical += segment.size;
+            logical += segment.logical;
+        }
+
+        physicalBytes = physical;
+        logicalBytes = logical;
+        span.count(physical, result.size());
+        return result;
+    }
+
+    void DiskImage::append(const FileData& data) {
+        TraceSpan span("disk append");
+        size_t logical;
+        string record = formatRecord(data, logical, compression);
+        span.count(record.size(), 1);
+
+        lock_guard<mutex> lock(diskMutex);
+        rethrowWriterError();
+
+        Operation operation;
+        operation.segment = placeRecord(record.size(), logical, data.path);
+        operation.bytes = std::move(record);
+        operation.records = 1;
+        queue.push_back(std::move(operation));
+        queuedOperations++;
+        workAvailable.notify_one();
+    }
+
+    void DiskImage::append(const vector<FileData>& batch) {
+        TraceSpan span("disk append");
+
+        // Compressing the contents is the slow part, the records are formatted by as many threads as there are cores
+        vector<string> records(batch.size());
+        vector<size_t> logicals(batch.size());
+        atomic<size_t> nextRecord{0};
+        auto formatRecords = [&] {
+            for (size_t i = nextRecord++; i < batch.size(); i = nextRecord++)
+                records[i] = formatRecord(batch[i], logicals[i], compression);
+        };
+
+        size_t threadCount = min<size_t>(batch.size() / 64 + 1, max(1u, thread::hardware_concurrency()));
+        vector<thread> workers;
+        for (size_t i = 1; i < threadCount; i++)
+            workers.emplace_back(formatRecords);
+        formatRecords();
+        for (auto& worker : workers)
+            worker.join();
+
+        lock_guard<mutex> lock(diskMutex);
+        rethrowWriterError();
+
+        // Records of the same segment share one operation, so they are written with one write
+        size_t firstOperation = queue.size();
+        for (size_t i = 0; i < batch.size(); i++) {
+            size_t activeId = placeRecord(records[i].size(), logicals[i], batch[i].path);
+            if (queue.size() == firstOperation || queue.back().segment != activeId) {
+                queue.emplace_back();
+                queue.back().segment = activeId;
+                queuedOperations++;
+            }
+            queue.back().bytes += records[i];
+            queue.back().records++;
+            span.count(records[i].size(), 1);
+        }
+        workAvailable.notify_one();
+    }
+
+    size_t DiskImage::placeRecord(size_t recordSize, size_t logical, const string& recordPath) {
+        if (segments.empty())
+            segments[0];
+
+        // Start a new segment when the record does not fit into the active one
+        size_t activeId = segments.rbegin()->first;
+        if (segments[activeId].size > 0 && segments[activeId].size + recordSize > segmentSize)
+            activeId++;
+
+        Segment& active = segments[activeId];
+        active.size += recordSize;
+        active.logical += logical;
+        physicalBytes += recordSize;
+        logicalBytes += logical;
+        segmentsOfPath.emplace(recordPath, activeId);
+        return activeId;
+    }
+
+    void DiskImage::removeRecords(const vector<string>& paths) {
+        lock_guard<mutex> lock(diskMutex);
+        rethrowWriterError();
+
+        // Find the segments that hold the paths now, records that are added later are not removed
+        Operation operation;
+        operation.removal = true;
+        for (const auto& filePath : paths) {
+            auto range = segmentsOfPath.equal_range(filePath);
+            for (auto it = range.first; it != range.second; ++it)
+                operation.segments.insert(it->second);
+            segmentsOfPath.erase(filePath);
+            operation.paths.insert(filePath);
+        }
+
+        if (operation.segments.empty())
+            return;
+        queue.push_back(std::move(operation));
+        queuedOperations++;
+        workAvailable.notify_one();
+    }
+
+    void DiskImage::sync() {
+        TraceSpan span("disk sync");
+        unique_lock<mutex> lock(diskMutex);
+        uint64_t target = queuedOperations;
+        flushed.wait(lock, [this, target] { return writtenOperations >= target; });
+        rethrowWriterError();
+    }
+
+    void DiskImage::rethrowWriterError() {
+        if (writerError) {
+            exception_ptr error = writerError;
+            writerError = nullptr;
+            rethrow_exception(error);
+        }
+    }
+
+    void DiskImage::runWriter() {
+        Trace::nameThread("disk writer");
+        unique_lock<mutex> lock(diskMutex);
+        while (true) {
+            workAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return; // Stopping and everything is written
+
+            // Take everything that is queued so far, it is written as one batch with one fsync per file
+            deque<Operation> operations;
+            operations.swap(queue);
+            uint64_t batchEnd = queuedOperations;
+
+            lock.unlock();
+            exception_ptr error;
+            try {
+                applyOperations(operations);
+            } catch (...) {
+                error = current_exception();
+            }
+            lock.lock();
+
+            if (error)
+                writerError = error;
+            writtenOperations = batchEnd;
+            flushed.notify_all();
+        }
+    }
+
+    void DiskImage::applyOperations(deque<Operation>& operations) {
+        map<size_t, string> appends;
+        size_t appendedRecords = 0;
+
+        // Appends are grouped per segment, a removal first makes the appends before it durable
+        auto writeAppends = [this, &appends, &appendedRecords] {
+            if (appends.empty())
+                return;
+            TraceSpan span("disk write");
+            vector<int> written;
+            for (auto& segmentRecords : appends) {
+                int fd = appendFdOf(segmentRecords.first);
+                writeFully(fd, segmentRecords.second, segmentPath(segmentRecords.first));
+                written.push_back(fd);
+                span.count(segmentRecords.second.size(), 0);
+            }
+            span.count(0, appendedRecords);
+            for (int fd : written) {
+                if (durable && fdatasync(fd) != 0)
+                    throw DiskWriteFailed(path, strerror(errno));
+            }
+            appends.clear();
+            appendedRecords = 0;
+        };
+
+        for (size_t i = 0; i < operations.size(); i++) {
+            if (!operations[i].removal) {
+                appends[operations[i].segment] += operations[i].bytes;
+                appendedRecords += operations[i].records;
+                continue;
+            }
+            writeAppends();
+
+            // Removals that follow each other rewrite every affected segment only once
+            set<string> paths;
+            set<size_t> affected;
+            for (; i < operations.size() && operations[i].removal; i++) {
+                paths.insert(operations[i].paths.begin(), operations[i].paths.end());
+                affected.insert(operations[i].segments.begin(), operations[i].segments.end());
+            }
+            i--;
+
+            for (size_t id : affected)
+                rewriteSegment(id, paths);
+            dropEmptySegments(affected);
+        }
+        writeAppends();
+    }
+
+    int DiskImage::appendFdOf(size_t id) {
+        int fd;
+        {
+            lock_guard<mutex> lock(diskMutex);
+            Segment& segment = segments[id];
+            if (segment.appendFd < 0) {
+                string segmentFile = segmentPath(id);
+                segment.appendFd = open(segmentFile.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+                if (segment.appendFd < 0)
+                    throw DiskWriteFailed(segmentFile, strerror(errno));
+            }
+            fd = segment.appendFd;
+        }
+
+        // A new segment is listed in the manifest once its file exists and before records are written to it
+        if (manifestSegments.insert(id).second)
+            writeManifest();
+        return fd;
+    }
+
+    void DiskImage::writeManifest() {
+        string manifest;
+        for (size_t id : manifestSegments)
+            manifest += to_string(id) + "\n";
+        writeFileAtomically(manifestPath(), manifest);
+    }
+
+    void DiskImage::syncDirectory() const {
+        if (!durable)
+            return;
+
+        // The rename is only durable once the directory that holds the disk is synced
+        int dirFd = open(directoryOf(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0)
+            return;
+        fsync(dirFd);
+        close(dirFd);
+    }
+
+    void DiskImage::rewriteSegment(size_t id, const set<string>& paths) {
+        TraceSpan span("image rewrite");
+        string segmentFile = segmentPath(id);
+        span.setDetail(segmentFile);
+        string buffer = readFile(segmentFile);
+        vector<Record> records;
+        vector<Range> damagedRanges;
+        size_t validLength = parseRecords(buffer, segmentFile, records, damagedRanges);
+
+        // Everything except the removed records is written byte for byte, damaged bytes between records included
+        string survivors;
+        survivors.reserve(buffer.size());
+        size_t copied = 0;
+        size_t removedLogical = 0;
+        size_t removedRecords = 0;
+        for (const auto& record : records) {
+            if (!paths.count(record.data.path))
+                continue;
+            survivors.append(buffer, copied, record.offset - copied);
+            copied = record.offset + record.length;
+            removedLogical += logicalLength(record);
+            removedRecords++;
+        }
+        survivors.append(buffer, copied, validLength - copied);
+
+        // Bytes that are kept and records that are dropped
+        span.count(survivors.size(), removedRecords);
+        if (survivors.size() == buffer.size())
+            return;
+        writeFileAtomically(segmentFile, survivors);
+
+        lock_guard<mutex> lock(diskMutex);
+
+        // The append descriptor still points to the replaced file
+        Segment& segment = segments[id];
+        if (segment.appendFd >= 0) {
+            close(segment.appendFd);
+            segment.appendFd = -1;
+        }
+
+        // Records queued after the removal are already counted in the size, so only the difference is applied
+        size_t removedBytes = buffer.size() - survivors.size();
+        segment.size -= removedBytes;
+        segment.logical -= removedLogical;
+        physicalBytes -= removedBytes;
+        logicalBytes -= removedLogical;
+    }
+
+    void DiskImage::dropEmptySegments(const set<size_t>& ids) {
+        vector<size_t> emptySegments;
+        {
+            // The first and the active segment always stay
+            lock_guard<mutex> lock(diskMutex);
+            for (size_t id : ids) {
+                auto it = segments.find(id);
+                if (id == 0 || it == segments.end() || id == segments.rbegin()->first || it->second.size != 0)
+                    continue;
+                if (it->second.appendFd >= 0)
+                    close(it->second.appendFd);
+                segments.erase(it);
+                emptySegments.push_back(id);
+            }
+        }
+
+        if (emptySegments.empty())
+            return;
+        for (size_t id : emptySegments)
+            manifestSegments.erase(id);
+        writeManifest();
+        for (size_t id : emptySegments)
+            unlink(segmentPath(id).c_str());
+    }
+
+    void DiskImage::setSegmentSize(size_t segmentSizeVal) {
+        segmentSize = segmentSizeVal;
+    }
+
+    size_t DiskImage::segmentCount() {
+        lock_guard<mutex> lock(diskMutex);
+        return segments.size();
+    }
+} //GTUShell namespace
@@ -0,0 +1,221 @@
+#ifndef DISKIMAGE_H
+#define DISKIMAGE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include "File.h"
+
+namespace GTUShell {
+    // Owns the files that hold the records of the file system.
+    //
+    // The records are split into segment files: disk.txt, disk.txt.1, disk.txt.2, ... New records are appended
+    // to the last (active) segment, a new segment is started once it reaches the segment size. The ids of the
+    // segments are listed in disk.txt.manifest; without a manifest disk.txt is the only segment.
+    //
+    // Record format:
+    //   T\tkey\tname\tdate\tsize\tlength[\tencoding]\tcrc\n~0~\n<length bytes of content>\n~0~\n
+    // The key is the path of the file on older disks, one record per file. Newer disks have a record per inode
+    // (type F, S or D) and a record per directory entry (type E), see Directory::inodeKey and entryKey. Bytes
+    // appended to a regular file are stored as records of type A with the key of its inode.
+    // The crc covers the header up to the crc field and the content, so torn or damaged records are
+    // detected on load. Records without the length and crc fields (older disks) are read line by line.
+    // The encoding field is "lz" when the content of a regular file is stored compressed with LzCodec.
+    class DiskImage {
+    public:
+        // Decides what checkDiskSize counts: the bytes of the file or the bytes it would take uncompressed
+        enum class QuotaMode { physical, logical };
+
+        // Starts the writer thread of the disk
+        explicit DiskImage(string pathVal);
+        DiskImage(const DiskImage&) = delete;
+        DiskImage& operator=(const DiskImage&) = delete;
+        ~DiskImage();
+
+        // Reads and verifies every record, segments are parsed in parallel.
+        // Damaged records at the end of a segment are cut off. The damage found is reported to messages, in the
+        // order of the segments, once every segment is parsed.
+        vector<FileData> load(std::ostream& messages);
+
+        // Checks the manifest, the segments it lists and the header of the first record without loading the disk.
+        // Throws FileTypeInvalid or SegmentNotFound for a file that is not an image.
+        void checkImage() const;
+
+        // Queues a record to be added to the end of the disk and returns without waiting for the disk
+        void append(const FileData& data);
+
+        // Queues many records at once, the writer thread writes them with one write per segment and one fsync
+        void append(const vector<FileData>& batch);
+
+        // Queues the removal of every record with one of the given keys (paths on older disks). Only the segments
+        // that hold them are rewritten, each one with a synced temp file and an atomic rename.
+        void removeRecords(const vector<string>& paths);
+
+        // Waits until every operation queued before the call is durable.
+        // Errors of the writer thread are thrown from here (and from the next append or removal).
+        void sync();
+
+        // Sets the size a segment can grow to before a new one is started, the default is 4MB
+        void setSegmentSize(size_t segmentSizeVal);
+
+        // Number of segment files
+        size_t segmentCount();
+
+        // Sets the size limit of the disk, the default is 10MB of physical bytes
+        void setQuota(size_t maxBytesVal, QuotaMode quotaModeVal);
+        size_t getQuota() const;
+        QuotaMode getQuotaMode() const;
+
+        // Throws DiskExceedsLimit if the disk is larger than its quota
+        void checkDiskSize() const;
+
+        // Throws DiskQuotaExceeded if the disk would be larger than its quota with bytes more. Changes call it
+        // before they touch the tree, with their size before compression.
+        void reserve(size_t bytes) const;
+
+        // Size of the segment files and the size they would have without compression
+        size_t physicalSize() const;
+        size_t logicalSize() const;
+
+        // Contents shorter than this are never compressed
+        static const size_t minCompressSize = 64;
+
+        // Compression of new records is on by default, records that are already compressed stay compressed
+        void setCompression(bool compressionVal);
+
+        // When durability is off, records are written without fsync (only used for comparing throughput)
+        void setDurable(bool durableVal);
+
+        // Takes the durability, compression, segment size and quota of the other disk
+        void useSettingsOf(const DiskImage& other);
+
+        bool isDurable() const;
+        bool usesCompression() const;
+        size_t getSegmentSize() const;
+
+        const string& getPath() const;
+
+        // CRC-32 of the manifest and of every segment in the order of the manifest, which tells two images apart.
+        // Both read the files as they are, so they are called before anything is queued.
+        uint32_t imageChecksum() const;
+        // Copies the manifest and the segments to the files of an image at the destination path
+        void copyImage(const string& destination) const;
+
+        // Standard CRC-32 of the given bytes, crc can be given to continue a previous checksum
+        static uint32_t checksum(const char* data, size_t size, uint32_t crc = 0);
+
+        // Turns the data into the bytes of a record
+        static string formatRecord(const FileData& data);
+
+    private:
+        // The quota and the file it applies to, for the messages of checkDiskSize and reserve
+        string describeQuota() const;
+
+        struct Record {
+            FileData data;
+            size_t offset;
+            size_t length;
+        };
+
+        struct Segment {
+            size_t size = 0;
+            size_t logical = 0;
+            int appendFd = -1;
+        };
+
+        // An operation waiting for the writer thread: record bytes for a segment or paths to remove
+        struct Operation {
+            bool removal = false;
+            size_t segment = 0;
+            string bytes;
+            // Number of records in bytes
+            size_t records = 0;
+            std::set<string> paths;
+            std::set<size_t> segments;
+        };
+
+        string path;
+        bool durable = true;
+        bool compression = true;
+        size_t maxBytes = 10 * 1024 * 1024;
+        size_t segmentSize = 4 * 1024 * 1024;
+        QuotaMode quotaMode = QuotaMode::physical;
+        std::atomic<size_t> physicalBytes{0};
+        std::atomic<size_t> logicalBytes{0};
+
+        // The writer thread applies the queued operations in order. Everything that is queued while it is
+        // writing is taken as one batch the next time, so bursts of mutations share their writes and fsyncs.
+        std::mutex diskMutex;
+        std::condition_variable workAvailable;
+        std::condition_variable flushed;
+        std::deque<Operation> queue;
+        uint64_t queuedOperations = 0;
+        uint64_t writtenOperations = 0;
+        bool stopping = false;
+        std::exception_ptr writerError;
+        std::thread writer;
+
+        // Segments by id, the last one is active. Sizes include the queued records.
+        std::map<size_t, Segment> segments;
+
+        // Segments listed in the manifest on the disk, only used by the writer thread
+        std::set<size_t> manifestSegments;
+
+        // The segments that hold the records of each path
+        std::unordered_multimap<string, size_t> segmentsOfPath;
+
+        // Bytes of a segment that hold a damaged record
+        struct Range {
+            size_t offset;
+            size_t length;
+        };
+
+        // Parses the record at start. Returns the position after it, or string::npos when it is damaged. With
+        // checksummedOnly only records with a valid checksum are accepted and nothing is thrown.
+        static size_t parseRecord(const string& buffer, const string& name, size_t start, Record& record,
+                                  bool checksummedOnly);
+
+        // Parses the records of a segment. A damaged record is skipped up to the next record with a valid checksum
+        // and its bytes are added to damagedRanges; damage that no valid record follows is a torn write.
+        // Returns the number of bytes before that torn end. Throws RecordDamaged when only older records, which
+        // have no checksum, follow the damage.
+        static size_t parseRecords(const string& buffer, const string& name, vector<Record>& records,
+                                   vector<Range>& damagedRanges);
+
+        // Also returns the number of bytes the record would take without compression
+        static string formatRecord(const FileData& data, size_t& logical, bool compression);
+
+        // Number of bytes the record would take if its content was not compressed
+        static size_t logicalLength(const Record& record);
+
+        string segmentPath(size_t id) const;
+        string manifestPath() const;
+        vector<size_t> readManifest() const;
+        void writeManifest();
+
+        // Adds a queued record of the given size to the active segment, or to a new one if it does not fit.
+        // Returns the id of the segment, diskMutex must be held.
+        size_t placeRecord(size_t recordSize, size_t logical, const string& recordPath);
+
+        // Opens the segment for appending if needed and returns its descriptor
+        int appendFdOf(size_t id);
+
+        void runWriter();
+        void applyOperations(std::deque<Operation>& operations);
+        void rewriteSegment(size_t id, const std::set<string>& paths);
+        void dropEmptySegments(const std::set<size_t>& ids);
+        void rethrowWriterError();
+        void writeFileAtomically(const string& filePath, const string& bytes) const;
+        void syncDirectory() const;
+    };
+} //GTUShell namespace
+
+#endif //DISKIMAGE_H
@@ -1,66 +1,111 @@
 #include "File.h"
+#include "Directory.h"
+#include "Inode.h"
 
 namespace GTUShell {
 
-    string File::getName() const {
-        return data.name;
+    void File::setEntry(const string& nameVal, Inode* inodeVal) {
+        name = nameVal;
+        inode = inodeVal;
+        inode->linkCount++;
     }
 
-    void File::setData(const FileData &newData) {
-        data = newData;
+    const string& File::getName() const {
+        return name;
     }
 
     char File::getType() const {
-        return data.type;
+        return inode->type;
     }
 
     string File::getPath() const {
-        return data.path;
+        // The "." entry of the root is the root itself
+        vector<const string*> names;
+        for (const File* node = this; node->parent; node = node->parent) {
+            if (node->name != ".")
+                names.push_back(&node->name);
+        }
+        if (names.empty())
+            return "/";
+
+        string path;
+        for (auto it = names.rbegin(); it != names.rend(); ++it)
+            path += "/" + **it;
+        return path;
     }
 
-    string File::getContent() const {
-        return data.content;
+    const string& File::getContent() const {
+        return inode->content;
     }
 
     string File::getDate() const {
-        return data.date;
+        return Timestamp::format(inode->time);
+    }
+
+    int64_t File::getTime() const {
+        return inode->time;
     }
 
     int File::getSize() const {
-        return data.size;
+        return inode->size;
     }
 
-    void File::cat() const {
+    bool File::isCompressed() const {
+        return inode->compressed;
+    }
+
+    Inode* File::getInode() const {
+        return inode;
+    }
+
+    Directory* File::getParent() const {
+        return parent;
+    }
+
+    NodeHandle File::getHandle() const {
+        return handle;
+    }
+
+    void File::cat(std::ostream& out) const {
         auto it = begin();
         auto endIt = end();
 
         // Loop through the File using their iterators
         for (it; it != endIt; ++it) {
-            cout << *it;
+            out << *it;
         }
 
-        cout << "\n";
+        out << "\n";
     }
 
-    void File::checkDiskSize() {
-        ifstream inputStream("disk.txt", std::ios::binary);
-
-        if (!inputStream.is_open()) {
-            return;
-        }
-
-        // Move file pointer to the end
-        inputStream.seekg(0, std::ios::end);
+    char FileIterator::entryByte() const {
+        checkVersion();
+        const File& entry = *(*entries)[child];
+        const string& name = entry.getName();
+
+        if (offset == 0)
+            return entry.getType();
+        if (offset == 1)
+            return '\t';
+        if (offset < name.size() + 2)
+            return name[offset - 2];
+        return '\n';
+    }
 
-        // Get the file by getting the position of file pointer
-        size_t fileSize = inputStream.tellg();
+    void FileIterator::nextEntryByte() {
+        checkVersion();
+        size_t lineLength = (*entries)[child]->getName().size() + 2;
 
-        // Check if the file exceeds 10MB
-        size_t maxFileSize = 10*1024*1024;
-        if (fileSize > maxFileSize) {
-            throw DiskExceedsLimit();
+        // The last line has no \n, the end of the directory is the position after its name
+        offset++;
+        if (offset > lineLength || (offset == lineLength && child + 1 == entries->size())) {
+            child++;
+            offset = 0;
         }
+    }
 
-        inputStream.close();
+    void FileIterator::checkVersion() const {
+        if (*liveVersion != version)
+            throw IteratorInvalidated();
     }
-}
\ No newline at end of file
+}
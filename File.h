@@ -1,6 +1,7 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <utility>
@@ -32,35 +33,150 @@ namespace GTUShell {
         string date;
         int size;
         string content;
+        // True if content holds the compressed bytes of a regular file, size is always the original size
+        bool compressed = false;
     };
 
+    class File;
+
+    // Compact reference to a node of an arena. Slots of removed nodes are reused, the generation tells the nodes
+    // of a slot apart, so a handle to a removed node never resolves to the node that took its place.
+    struct NodeHandle {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+
+        explicit operator bool() const { return index != UINT32_MAX; }
+        bool operator==(const NodeHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const NodeHandle& other) const { return !(*this == other); }
+    };
+
+    // Iterates over the bytes of a file without copying them. Regular files are walked through their content and
+    // directories through their children, which are formatted as "T\tname" lines while iterating. A directory
+    // iterator stops being valid when the directory is modified, using it afterwards throws IteratorInvalidated.
+    class FileIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = char;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const char*;
+        using reference = char;
+
+        FileIterator() = default;
+
+        // Iterator over a range of bytes, also used as the end of a content
+        explicit FileIterator(const char* positionVal) : position(positionVal) { }
+
+        // Iterator over the bytes of a range followed by the bytes of a second one (the pieces of a content)
+        FileIterator(const char* positionVal, const char* rangeEndVal, const char* nextVal, const char* nextEndVal)
+                : position(positionVal), rangeEnd(rangeEndVal), next(nextVal), nextEnd(nextEndVal) {
+            skipEmptyRange();
+        }
+
+        // Iterator over the children of a directory, starting at the given child
+        FileIterator(const vector<File*>* entriesVal, size_t childVal, const uint64_t* versionVal)
+                : entries(entriesVal), child(childVal), liveVersion(versionVal), version(*versionVal) { }
+
+        char operator*() const { return entries ? entryByte() : *position; }
+
+        FileIterator& operator++() {
+            if (entries) {
+                nextEntryByte();
+            } else {
+                ++position;
+                skipEmptyRange();
+            }
+            return *this;
+        }
+
+        FileIterator operator++(int) {
+            FileIterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const FileIterator& other) const {
+            return position == other.position && entries == other.entries && child == other.child &&
+                   offset == other.offset;
+        }
+
+        bool operator!=(const FileIterator& other) const { return !(*this == other); }
+
+    private:
+        const char* position = nullptr;
+        const char* rangeEnd = nullptr;
+        const char* next = nullptr;
+        const char* nextEnd = nullptr;
+
+        const vector<File*>* entries = nullptr;
+        size_t child = 0;
+        // Index of the byte in the line of the child, the \n after the name comes last
+        size_t offset = 0;
+        const uint64_t* liveVersion = nullptr;
+        uint64_t version = 0;
+
+        // Continues with the second range at the end of the first one
+        void skipEmptyRange() {
+            if (position == rangeEnd && next) {
+                position = next;
+                rangeEnd = nextEnd;
+                next = nullptr;
+            }
+        }
+
+        char entryByte() const;
+        void nextEntryByte();
+        void checkVersion() const;
+    };
+
+    class Directory;
+    class Inode;
+
+    // An entry of a directory: a name and the inode it refers to
     class File {
     public:
         File() = default;
-        explicit File(FileData dataVal) : data(std::move(dataVal)) { }
 
-        virtual void cat() const;
+        virtual void cat(std::ostream& out) const;
 
         // Pure virtual iterator function definitions
-        using iterator = std::string::const_iterator;
+        using iterator = FileIterator;
         virtual iterator begin() const = 0;
         virtual iterator end() const = 0;
 
-        // Setters and getters for the class
-        void setData(const FileData& newData);
+        // Setter for the name of the entry and the inode it refers to, the inode gets one more link
+        void setEntry(const string& nameVal, Inode* inodeVal);
+
+        // Setters and getters for the class. The metadata and the content come from the inode.
         char getType() const;
+        // The path is built from the names of the directories above, so moving a directory does not have to
+        // touch the entries inside it
         string getPath() const;
-        string getName() const;
-        string getContent() const;
+        const string& getName() const;
+        const string& getContent() const;
+        // The date as it is shown, getTime is the same date as an integer
         string getDate() const;
+        int64_t getTime() const;
         int getSize() const;
+        bool isCompressed() const;
+        Inode* getInode() const;
 
-        static void checkDiskSize();
+        // The directory the entry is in, nullptr for the root
+        Directory* getParent() const;
+
+        // Handle of the node in the arena that owns it, empty for nodes that are not in an arena
+        NodeHandle getHandle() const;
 
         virtual ~File() = default;
 
     protected:
-        FileData data;
+        string name;
+        Inode* inode = nullptr;
+
+    private:
+        friend class NodeArena;
+        friend class Directory;
+        Directory* parent = nullptr;
+        NodeHandle handle;
     };
 
 } // GTUShell namespace
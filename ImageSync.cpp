@@ -0,0 +1,365 @@
+#include "ImageSync.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DiskImage.h"
+#include "Inode.h"
+#include "LzCodec.h"
+#include "ShellExceptions.h"
+
+namespace GTUShell {
+    namespace {
+        // The content as it is read, compressed contents are decompressed
+        string logicalContent(const FileData& record) {
+            return record.compressed ? LzCodec::decompress(record.content, record.size) : record.content;
+        }
+
+        vector<FileData> loadImage(const string& path) {
+            if (access(path.c_str(), F_OK) != 0)
+                throw PathNotFound(path);
+            DiskImage disk(path);
+            return disk.load(std::cerr);
+        }
+
+        // Records of an image grouped by their key, in the order of the first record of every key
+        struct KeyGroups {
+            vector<string> keys;
+            std::unordered_map<string, vector<const FileData*> > records;
+
+            explicit KeyGroups(const vector<FileData>& all) {
+                for (const auto& record : all) {
+                    auto& group = records[record.path];
+                    if (group.empty())
+                        keys.push_back(record.path);
+                    group.push_back(&record);
+                }
+            }
+        };
+
+        // Header fields and content of a record, compared without the key and without the encoding on the disk
+        uint64_t recordHash(const FileData& record, const string& content) {
+            string header = string(1, record.type) + "\t" + record.name + "\t" + record.date + "\t" +
+                            std::to_string(content.size());
+            uint64_t headerChecksum = DiskImage::checksum(header.data(), header.size());
+            return headerChecksum << 32 | DiskImage::checksum(content.data(), content.size());
+        }
+
+        // Bytes of a record besides its content: the key, the name, the date, the type and the sizes
+        size_t headerBytes(const FileData& record) {
+            return record.path.size() + record.name.size() + record.date.size() + 16;
+        }
+
+        // Weak checksum of rsync: a is the sum of the bytes, b the sum of the running values of a, both mod 2^16
+        uint32_t weakChecksum(const char* data, size_t length, uint32_t& a, uint32_t& b) {
+            a = 0;
+            b = 0;
+            for (size_t i = 0; i < length; i++) {
+                a += static_cast<unsigned char>(data[i]);
+                b += static_cast<uint32_t>(length - i) * static_cast<unsigned char>(data[i]);
+            }
+            a &= 0xFFFF;
+            b &= 0xFFFF;
+            return a | b << 16;
+        }
+    }
+
+    std::map<string, ImageSync::Entry> ImageSync::entriesOf(const vector<FileData>& records) {
+        std::map<string, Entry> entries;
+        bool inodeLayout = std::any_of(records.begin(), records.end(), [](const FileData& record) {
+            return record.path.compare(0, 1, "#") == 0;
+        });
+
+        auto entryOf = [](const FileData& record) {
+            string content = logicalContent(record);
+            Entry entry{ record.type, content.size(), 0, "" };
+            if (record.type == 'F')
+                entry.contentChecksum = DiskImage::checksum(content.data(), content.size());
+            else if (record.type == 'S')
+                entry.target = content;
+            return entry;
+        };
+
+        if (!inodeLayout) {
+            // One record per path, the root is the same in every image
+            for (const auto& record : records) {
+                if (record.path != "/" && (record.type == 'F' || record.type == 'S' || record.type == 'D'))
+                    entries[record.path] = entryOf(record);
+            }
+            return entries;
+        }
+
+        // Inodes with their appended bytes, and the entries of every directory, like Directory::loadInodes
+        std::unordered_map<uint64_t, Entry> inodes;
+        std::unordered_map<uint64_t, vector<std::pair<string, uint64_t> > > entriesOfDirectory;
+        for (const auto& record : records) {
+            if (record.path.compare(0, 1, "#") != 0)
+                continue;
+            uint64_t number = strtoull(record.path.c_str() + 1, nullptr, 10);
+            if (record.type == 'A') {
+                auto it = inodes.find(number);
+                if (it != inodes.end()) {
+                    it->second.contentChecksum = DiskImage::checksum(record.content.data(), record.content.size(),
+                                                                      it->second.contentChecksum);
+                    it->second.size += record.content.size();
+                }
+            } else if (record.type == 'E') {
+                entriesOfDirectory[number].emplace_back(record.name, strtoull(record.content.c_str(), nullptr, 10));
+            } else {
+                inodes[number] = entryOf(record);
+            }
+        }
+
+        vector<std::pair<uint64_t, string> > pending = { { InodeTable::rootNumber, "" } };
+        std::unordered_set<uint64_t> visited = { InodeTable::rootNumber };
+        while (!pending.empty()) {
+            auto directory = pending.back();
+            pending.pop_back();
+            for (const auto& child : entriesOfDirectory[directory.first]) {
+                auto inodeIt = inodes.find(child.second);
+                if (inodeIt == inodes.end())
+                    continue;
+                string path = directory.second + "/" + child.first;
+                entries[path] = inodeIt->second;
+                // A directory is only entered once, a second entry would make a loop
+                if (inodeIt->second.type == 'D' && visited.insert(child.second).second)
+                    pending.emplace_back(child.second, path);
+            }
+        }
+        return entries;
+    }
+
+    vector<ImageSync::Change> ImageSync::diff(const string& fromPath, const string& toPath) {
+        std::map<string, Entry> from = entriesOf(loadImage(fromPath));
+        std::map<string, Entry> to = entriesOf(loadImage(toPath));
+
+        vector<Change> changes;
+        auto fromIt = from.begin();
+        auto toIt = to.begin();
+        while (fromIt != from.end() || toIt != to.end()) {
+            if (toIt == to.end() || (fromIt != from.end() && fromIt->first < toIt->first)) {
+                changes.push_back({ '-', fromIt->first, string(1, fromIt->second.type) });
+                ++fromIt;
+            } else if (fromIt == from.end() || toIt->first < fromIt->first) {
+                changes.push_back({ '+', toIt->first, string(1, toIt->second.type) });
+                ++toIt;
+            } else {
+                const Entry& before = fromIt->second;
+                const Entry& after = toIt->second;
+                string detail;
+                if (before.type != after.type) {
+                    detail = string(1, before.type) + " -> " + after.type;
+                } else if (before.type == 'S' && before.target != after.target) {
+                    detail = before.target + " -> " + after.target;
+                } else if (before.type == 'F' && (before.size != after.size
+                                                   || before.contentChecksum != after.contentChecksum)) {
+                    detail = std::to_string(before.size) + " -> " + std::to_string(after.size) + " bytes";
+                }
+                if (!detail.empty())
+                    changes.push_back({ '~', fromIt->first, detail });
+                ++fromIt;
+                ++toIt;
+            }
+        }
+        return changes;
+    }
+
+    vector<ImageSync::DeltaPiece> ImageSync::delta(const string& oldContent, const string& newContent,
+                                                   size_t blockSize) {
+        vector<DeltaPiece> pieces;
+        size_t blockCount = oldContent.size() / blockSize;
+        size_t length = newContent.size();
+        if (blockCount == 0 || length < blockSize)
+            return { { false, 0, length } };
+
+        // Whole blocks of the old content by their weak checksum, the strong one tells the candidates apart
+        std::unordered_map<uint32_t, vector<size_t> > blocksByWeak;
+        vector<uint32_t> strong(blockCount);
+        for (size_t block = 0; block < blockCount; block++) {
+            const char* data = oldContent.data() + block * blockSize;
+            uint32_t a, b;
+            blocksByWeak[weakChecksum(data, blockSize, a, b)].push_back(block);
+            strong[block] = DiskImage::checksum(data, blockSize);
+        }
+
+        const char* data = newContent.data();
+        size_t position = 0;
+        size_t literalStart = 0;
+        uint32_t a, b;
+        uint32_t weak = weakChecksum(data, blockSize, a, b);
+        while (position + blockSize <= length) {
+            size_t matched = SIZE_MAX;
+            auto candidates = blocksByWeak.find(weak);
+            if (candidates != blocksByWeak.end()) {
+                uint32_t checksum = DiskImage::checksum(data + position, blockSize);
+                for (size_t block : candidates->second) {
+                    if (strong[block] == checksum) {
+                        matched = block;
+                        break;
+                    }
+                }
+            }
+
+            if (matched != SIZE_MAX) {
+                if (literalStart < position)
+                    pieces.push_back({ false, literalStart, position - literalStart });
+                // Blocks that follow each other in both contents become one copy
+                size_t offset = matched * blockSize;
+                if (!pieces.empty() && pieces.back().copy && pieces.back().offset + pieces.back().length == offset)
+                    pieces.back().length += blockSize;
+                else
+                    pieces.push_back({ true, offset, blockSize });
+                position += blockSize;
+                literalStart = position;
+                if (position + blockSize <= length)
+                    weak = weakChecksum(data + position, blockSize, a, b);
+                continue;
+            }
+
+            // Move the window one byte: the first byte leaves, the byte after the window comes in
+            if (position + blockSize < length) {
+                uint32_t out = static_cast<unsigned char>(data[position]);
+                uint32_t in = static_cast<unsigned char>(data[position + blockSize]);
+                a = (a - out + in) & 0xFFFF;
+                b = (b - static_cast<uint32_t>(blockSize) * out + a) & 0xFFFF;
+                weak = a | b << 16;
+            }
+            position++;
+        }
+        if (literalStart < length)
+            pieces.push_back({ false, literalStart, length - literalStart });
+        return pieces;
+    }
+
+    ImageSync::SyncReport ImageSync::sync(const string& sourcePath, const string& destinationPath) {
+        SyncReport report;
+        vector<FileData> sourceRecords = loadImage(sourcePath);
+        DiskImage destination(destinationPath);
+        vector<FileData> destinationRecords;
+        if (access(destinationPath.c_str(), F_OK) == 0)
+            destinationRecords = destination.load(std::cerr);
+
+        KeyGroups source(sourceRecords);
+        KeyGroups existing(destinationRecords);
+
+        vector<string> removedKeys;
+        vector<FileData> batch;
+        // Adds the record to the batch with its content as it is read, the destination compresses it again
+        auto send = [&](const FileData& record, string content) {
+            FileData copy = record;
+            copy.compressed = false;
+            copy.size = static_cast<int>(content.size());
+            copy.content = std::move(content);
+            batch.push_back(std::move(copy));
+        };
+
+        for (const auto& key : source.keys) {
+            const auto& records = source.records[key];
+            vector<string> contents;
+            vector<uint64_t> hashes;
+            for (const FileData* record : records) {
+                contents.push_back(logicalContent(*record));
+                hashes.push_back(recordHash(*record, contents.back()));
+                report.sourceBytes += contents.back().size();
+            }
+
+            auto existingIt = existing.records.find(key);
+            if (existingIt == existing.records.end()) {
+                for (size_t i = 0; i < records.size(); i++) {
+                    report.sentBytes += headerBytes(*records[i]) + contents[i].size();
+                    send(*records[i], std::move(contents[i]));
+                }
+                report.addedKeys++;
+                continue;
+            }
+
+            // The hashes of the destination tell whether the key is the same, or only misses appends at its end
+            vector<string> oldContents;
+            size_t common = 0;
+            for (const FileData* record : existingIt->second) {
+                oldContents.push_back(logicalContent(*record));
+                if (common == oldContents.size() - 1 && common < hashes.size()
+                    && recordHash(*record, oldContents.back()) == hashes[common])
+                    common++;
+            }
+            if (common == oldContents.size() && common == hashes.size()) {
+                report.keptKeys++;
+                continue;
+            }
+            if (common == oldContents.size()) {
+                for (size_t i = common; i < records.size(); i++) {
+                    report.sentBytes += headerBytes(*records[i]) + contents[i].size();
+                    send(*records[i], std::move(contents[i]));
+                    report.appendedRecords++;
+                }
+                continue;
+            }
+
+            // Replaced: every record of the key is written again, large contents are built from the blocks of the
+            // old ones and only the bytes that were not found are sent
+            removedKeys.push_back(key);
+            report.replacedKeys++;
+            string basis;
+            for (const auto& oldContent : oldContents)
+                basis += oldContent;
+            for (size_t i = 0; i < records.size(); i++) {
+                report.sentBytes += headerBytes(*records[i]);
+                const string& content = contents[i];
+                if (content.size() < deltaMinSize || basis.empty()) {
+                    report.sentBytes += content.size();
+                    send(*records[i], std::move(contents[i]));
+                    continue;
+                }
+
+                size_t blockSize = std::clamp<size_t>(static_cast<size_t>(std::sqrt(content.size())), 512, 16384);
+                string rebuilt;
+                rebuilt.reserve(content.size());
+                size_t sent = 0;
+                size_t reused = 0;
+                for (const auto& piece : delta(basis, content, blockSize)) {
+                    if (piece.copy) {
+                        rebuilt.append(basis, piece.offset, piece.length);
+                        reused += piece.length;
+                        sent += 16;
+                    } else {
+                        rebuilt.append(content, piece.offset, piece.length);
+                        sent += piece.length;
+                    }
+                }
+                // Blocks with the same checksums but other bytes would build another content, the whole content
+                // is sent then
+                if (DiskImage::checksum(rebuilt.data(), rebuilt.size()) !=
+                    DiskImage::checksum(content.data(), content.size())) {
+                    report.sentBytes += content.size();
+                    send(*records[i], std::move(contents[i]));
+                    continue;
+                }
+                report.sentBytes += sent + 4;
+                report.reusedBytes += reused;
+                report.deltaRecords++;
+                send(*records[i], std::move(rebuilt));
+            }
+        }
+
+        for (const auto& key : existing.keys) {
+            if (source.records.find(key) == source.records.end()) {
+                removedKeys.push_back(key);
+                report.removedKeys++;
+            }
+        }
+
+        // The old records of a key are removed before its new records are queued, a removal only takes the records
+        // that are on the disk when it is queued
+        if (!removedKeys.empty())
+            destination.removeRecords(removedKeys);
+        if (!batch.empty())
+            destination.append(batch);
+        destination.sync();
+        return report;
+    }
+} //GTUShell namespace
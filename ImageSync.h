@@ -0,0 +1,78 @@
+#ifndef IMAGESYNC_H
+#define IMAGESYNC_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "File.h"
+
+namespace GTUShell {
+    // Compares two disk images and brings one up to date with the other, used by ./imgdiff and ./imgsync.
+    // Neither needs the images to be loaded into a tree: entries are rebuilt from the records, and records are
+    // matched by their keys.
+    class ImageSync {
+    public:
+        // An entry of an image as imgdiff compares it. Dates are not compared, a file written again with the same
+        // content is not a change.
+        struct Entry {
+            char type;
+            uint64_t size;
+            // CRC-32 of the content of a regular file (its base and the appended bytes)
+            uint32_t contentChecksum;
+            // Target of a soft link
+            string target;
+        };
+
+        struct Change {
+            // '+' added, '-' removed, '~' changed
+            char kind;
+            string path;
+            string detail;
+        };
+
+        struct SyncReport {
+            size_t keptKeys = 0;
+            size_t addedKeys = 0;
+            size_t removedKeys = 0;
+            size_t replacedKeys = 0;
+            // Append records added to keys whose records in the destination were a prefix of the source's
+            size_t appendedRecords = 0;
+            // Logical bytes of content in the source
+            size_t sourceBytes = 0;
+            // Bytes that had to come from the source: headers, contents, and the literals and block references of
+            // the deltas of large contents
+            size_t sentBytes = 0;
+            // Bytes of large contents that were rebuilt from blocks the destination already had
+            size_t reusedBytes = 0;
+            size_t deltaRecords = 0;
+        };
+
+        // Contents from this size on are sent as a delta against the old content of the key
+        static const size_t deltaMinSize = 64 * 1024;
+
+        // Paths of the image and what they hold. Records of the older layout are keyed by path already.
+        static std::map<string, Entry> entriesOf(const vector<FileData>& records);
+
+        // What changed from the image at the first path to the image at the second one, in path order
+        static vector<Change> diff(const string& fromPath, const string& toPath);
+
+        // Makes the records of the destination the same as the ones of the source: keys that are missing or
+        // different are written, keys the source does not have are removed. Unchanged keys are not touched. A
+        // missing destination is created.
+        static SyncReport sync(const string& sourcePath, const string& destinationPath);
+
+        // The copy and literal instructions that build a new content from the blocks of an old one, found with a
+        // rolling checksum the way rsync does
+        struct DeltaPiece {
+            // Copies length bytes from offset of the old content when true, takes them from the literals otherwise
+            bool copy;
+            size_t offset;
+            size_t length;
+        };
+        static vector<DeltaPiece> delta(const string& oldContent, const string& newContent, size_t blockSize);
+    };
+} //GTUShell namespace
+
+#endif //IMAGESYNC_H
@@ -0,0 +1,120 @@
+#include "Inode.h"
+#include "LzCodec.h"
+
+#include <algorithm>
+
+namespace GTUShell {
+
+    Inode::Inode(FileData data)
+            : type(data.type), size(data.size), time(Timestamp::parse(data.date)), content(std::move(data.content)),
+              compressed(data.compressed) { }
+
+    const string& Inode::readableBase() const {
+        if (!compressed)
+            return content;
+
+        // Readers can run in parallel, so the first one decompresses while the others wait
+        std::call_once(decompressed, [this] {
+            plainContent = std::make_unique<string>(LzCodec::decompress(content, size - appended().size()));
+        });
+        return *plainContent;
+    }
+
+    FileIterator Inode::begin() const {
+        const string& base = readableBase();
+        if (!appendedBytes || appendedBytes->empty())
+            return FileIterator(base.data(), base.data() + base.size(), nullptr, nullptr);
+        return FileIterator(base.data(), base.data() + base.size(), appendedBytes->data(),
+                            appendedBytes->data() + appendedBytes->size());
+    }
+
+    FileIterator Inode::end() const {
+        if (!appendedBytes || appendedBytes->empty()) {
+            const string& base = readableBase();
+            return FileIterator(base.data() + base.size());
+        }
+        return FileIterator(appendedBytes->data() + appendedBytes->size());
+    }
+
+    void Inode::setContent(string contentVal) {
+        content = std::move(contentVal);
+        appendedBytes.reset();
+        appendRecords = 0;
+        size = static_cast<int>(content.size());
+        compressed = false;
+        plainContent.reset();
+    }
+
+    const string& Inode::appended() const {
+        static const string none;
+        return appendedBytes ? *appendedBytes : none;
+    }
+
+    void Inode::append(const string& bytes) {
+        if (!appendedBytes)
+            appendedBytes = std::make_unique<string>();
+        *appendedBytes += bytes;
+        size += static_cast<int>(bytes.size());
+    }
+
+    void Inode::fold() {
+        string joined;
+        joined.reserve(size);
+        joined += readableBase();
+        joined += appended();
+        setContent(std::move(joined));
+    }
+
+    InodeTable::~InodeTable() {
+        for (Inode* inode : byNumber) {
+            if (inode)
+                inode->~Inode();
+        }
+    }
+
+    Inode* InodeTable::create(FileData data, uint64_t number) {
+        if (number == 0)
+            number = nextNumber;
+        nextNumber = std::max(nextNumber, number + 1);
+        if (byNumber.size() <= number)
+            byNumber.resize(number + 1, nullptr);
+        if (byNumber[number])
+            destroy(byNumber[number]);
+
+        Inode* inode = pool.create(std::move(data));
+        inode->number = number;
+        byNumber[number] = inode;
+        liveInodes++;
+        return inode;
+    }
+
+    Inode* InodeTable::get(uint64_t number) const {
+        return number < byNumber.size() ? byNumber[number] : nullptr;
+    }
+
+    void InodeTable::unlink(Inode* inode) {
+        if (--inode->linkCount == 0)
+            destroy(inode);
+    }
+
+    size_t InodeTable::releaseUnlinked() {
+        size_t released = 0;
+        for (Inode* inode : byNumber) {
+            if (inode && inode->linkCount == 0 && inode->number != rootNumber) {
+                destroy(inode);
+                released++;
+            }
+        }
+        return released;
+    }
+
+    size_t InodeTable::size() const {
+        return liveInodes;
+    }
+
+    void InodeTable::destroy(Inode* inode) {
+        byNumber[inode->number] = nullptr;
+        liveInodes--;
+        pool.destroy(inode);
+    }
+} //GTUShell namespace
@@ -0,0 +1,104 @@
+#ifndef INODE_H
+#define INODE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "File.h"
+#include "ObjectPool.h"
+#include "Timestamp.h"
+
+namespace GTUShell {
+    // Type, size, date and content of a file. Directory entries refer to an inode, every entry of the same inode
+    // (a hard link) reads the same content.
+    class Inode {
+    public:
+        uint64_t number = 0;
+        char type = 'F';
+        // Size of the whole content, the base and the appended bytes
+        int size = 0;
+        // Seconds since 1970 of the local clock, see Timestamp
+        int64_t time = Timestamp::unknown;
+        // The content of a regular file is kept as two pieces: the base, as it is stored in the inode record, and
+        // the bytes appended after it. An append only adds to the second piece and never copies the base.
+        // For soft links the base is the path the link points to.
+        string content;
+        // Number of append records on the disk for the appended bytes
+        uint32_t appendRecords = 0;
+        // True if content holds the compressed bytes of the base, size - appended().size() is its original size
+        bool compressed = false;
+        // Number of directory entries that refer to the inode
+        uint32_t linkCount = 0;
+
+        Inode() = default;
+        explicit Inode(FileData data);
+
+        // The base as it is read, decompressed if it is stored compressed
+        const string& readableBase() const;
+
+        // Iterators over the readable base followed by the appended bytes
+        FileIterator begin() const;
+        FileIterator end() const;
+
+        // Replaces the content with uncompressed bytes
+        void setContent(string contentVal);
+
+        // The bytes appended after the base
+        const string& appended() const;
+
+        // Adds the bytes to the end of the content
+        void append(const string& bytes);
+
+        // Joins the pieces into a new uncompressed base
+        void fold();
+
+    private:
+        // Compressed bases are only decompressed the first time they are read. Bases only come in compressed from
+        // the disk, so the flag is never needed again once the base is replaced.
+        mutable std::once_flag decompressed;
+        mutable std::unique_ptr<string> plainContent;
+
+        // Only allocated once something is appended, most files never are
+        std::unique_ptr<string> appendedBytes;
+    };
+
+    // Owns the inodes of a tree by their numbers. Numbers are never reused, so a number that was valid once
+    // either finds the same inode or nothing.
+    class InodeTable {
+    public:
+        // Number of the inode of the root directory
+        static const uint64_t rootNumber = 1;
+
+        InodeTable() = default;
+        InodeTable(const InodeTable&) = delete;
+        InodeTable& operator=(const InodeTable&) = delete;
+        ~InodeTable();
+
+        // Creates an inode with the type, size, date and content of the data (the name and path are not used).
+        // Number 0 takes the next free number.
+        Inode* create(FileData data, uint64_t number = 0);
+
+        // Returns the inode with the number, nullptr if there is none
+        Inode* get(uint64_t number) const;
+
+        // Called when an entry stops referring to the inode, the inode is destroyed with its last link
+        void unlink(Inode* inode);
+
+        // Destroys the inodes no entry refers to (the root is kept), returns how many there were
+        size_t releaseUnlinked();
+
+        // Number of inodes that are alive
+        size_t size() const;
+
+    private:
+        ObjectPool<Inode> pool;
+        vector<Inode*> byNumber;
+        uint64_t nextNumber = rootNumber + 1;
+        size_t liveInodes = 0;
+
+        void destroy(Inode* inode);
+    };
+} //GTUShell namespace
+
+#endif //INODE_H
@@ -0,0 +1,199 @@
+#include "Jobs.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "ShellExceptions.h"
+#include "Trace.h"
+
+namespace GTUShell {
+    namespace {
+        thread_local const std::atomic<bool>* killFlag = nullptr;
+
+        const char* stateName(Job::State state) {
+            switch (state) {
+                case Job::State::queued:
+                    return "Queued";
+                case Job::State::running:
+                    return "Running";
+                case Job::State::done:
+                    return "Done";
+                case Job::State::failed:
+                    return "Failed";
+                default:
+                    return "Killed";
+            }
+        }
+
+        bool isFinished(Job::State state) {
+            return state == Job::State::done || state == Job::State::failed || state == Job::State::killed;
+        }
+    }
+
+    shared_ptr<Job> JobList::add(const string& line) {
+        auto job = std::make_shared<Job>();
+        job->line = line;
+        std::lock_guard<std::mutex> lock(listMutex);
+        job->number = nextNumber++;
+        jobs.push_back(job);
+        return job;
+    }
+
+    void JobList::setState(Job& job, Job::State state, string output) {
+        {
+            std::lock_guard<std::mutex> lock(listMutex);
+            job.state = state;
+            job.output = std::move(output);
+        }
+        if (isFinished(state))
+            finished.notify_all();
+    }
+
+    void JobList::list(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(listMutex);
+        for (const auto& job : jobs) {
+            out << "[" << job->number << "] " << std::left << std::setw(9) << stateName(job->state) << job->line
+                << "\n";
+        }
+    }
+
+    bool JobList::report(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(listMutex);
+        auto firstKept = std::stable_partition(jobs.begin(), jobs.end(), [](const shared_ptr<Job>& job) {
+            return isFinished(job->state);
+        });
+        bool failed = false;
+        for (auto it = jobs.begin(); it != firstKept; ++it) {
+            const Job& job = **it;
+            out << "[" << job.number << "] " << std::left << std::setw(9) << stateName(job.state) << job.line << "\n"
+                << job.output;
+            failed = failed || job.state == Job::State::failed;
+        }
+        jobs.erase(jobs.begin(), firstKept);
+        return failed;
+    }
+
+    bool JobList::kill(uint64_t number) {
+        std::lock_guard<std::mutex> lock(listMutex);
+        for (const auto& job : jobs) {
+            if (job->number == number) {
+                job->killRequested = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool JobList::wait(uint64_t number) {
+        std::unique_lock<std::mutex> lock(listMutex);
+        auto waited = [&](const shared_ptr<Job>& job) { return number == 0 || job->number == number; };
+        if (number != 0 && std::none_of(jobs.begin(), jobs.end(), waited))
+            return false;
+        finished.wait(lock, [&] {
+            return std::all_of(jobs.begin(), jobs.end(), [&](const shared_ptr<Job>& job) {
+                return !waited(job) || isFinished(job->state);
+            });
+        });
+        return true;
+    }
+
+    JobPool::JobPool(size_t threadCount) : running(threadCount) {
+        for (size_t i = 0; i < threadCount; i++)
+            workers.emplace_back(&JobPool::work, this, i);
+    }
+
+    JobPool::~JobPool() {
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            stopping = true;
+            for (const auto& task : tasks)
+                task.job->killRequested = true;
+            for (const auto& job : running) {
+                if (job)
+                    job->killRequested = true;
+            }
+        }
+        queued.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void JobPool::submit(const shared_ptr<JobList>& list, const shared_ptr<Job>& job,
+                         std::function<void(std::ostream&)> run) {
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            tasks.push_back({ list, job, std::move(run) });
+        }
+        queued.notify_one();
+    }
+
+    void JobPool::work(size_t index) {
+        Trace::nameThread("job worker " + std::to_string(index + 1));
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(poolMutex);
+                queued.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                running[index] = task.job;
+            }
+
+            // A job killed while it was queued never starts
+            Job& job = *task.job;
+            std::ostringstream output;
+            Job::State state = Job::State::killed;
+            if (!job.killRequested) {
+                task.list->setState(job, Job::State::running);
+                JobControl::setFlag(&job.killRequested);
+                try {
+                    task.run(output);
+                    state = Job::State::done;
+                } catch (const JobKilled&) {
+                    state = Job::State::killed;
+                } catch (const DiskExceedsLimit& err) {
+                    // The session applies the quota policy of its shell once the job is reported (see
+                    // Shell::execute), the worker goes on with the next job
+                    output << err.what() << "\n";
+                    state = Job::State::failed;
+                } catch (const ShellExceptions& err) {
+                    output << err.what() << "\n";
+                    state = Job::State::done;
+                } catch (const std::exception& err) {
+                    // Nothing may leave the worker thread, a host file system error or a failed allocation only
+                    // fails the job
+                    output << err.what() << "\n";
+                    state = Job::State::failed;
+                } catch (...) {
+                    output << "Unknown error\n";
+                    state = Job::State::failed;
+                }
+                JobControl::setFlag(nullptr);
+            }
+            task.list->setState(job, state, output.str());
+
+            std::lock_guard<std::mutex> lock(poolMutex);
+            running[index] = nullptr;
+        }
+    }
+
+    void JobControl::setFlag(const std::atomic<bool>* flag) {
+        killFlag = flag;
+    }
+
+    const std::atomic<bool>* JobControl::flag() {
+        return killFlag;
+    }
+
+    bool JobControl::killed() {
+        return killFlag && killFlag->load(std::memory_order_relaxed);
+    }
+
+    void JobControl::checkKilled() {
+        if (killed())
+            throw JobKilled();
+    }
+} //GTUShell namespace
@@ -0,0 +1,107 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+namespace GTUShell {
+    // A command line started with & that runs on a worker of the shell
+    struct Job {
+        // A job that took a disk over its quota is failed
+        enum class State { queued, running, done, failed, killed };
+
+        uint64_t number = 0;
+        string line;
+        State state = State::queued;
+        // Set by kill, the job stops at the next point that checks it
+        std::atomic<bool> killRequested{false};
+        // Everything the job printed, reported once it is finished
+        string output;
+    };
+
+    // The jobs of one session, numbered from 1 in the order they were started
+    class JobList {
+    public:
+        shared_ptr<Job> add(const string& line);
+
+        void setState(Job& job, Job::State state, string output = "");
+
+        // Prints a line for every job that has not been reported yet
+        void list(std::ostream& out) const;
+
+        // Prints the finished jobs with their output and forgets them, true if one of them failed
+        bool report(std::ostream& out);
+
+        // Asks the job to stop, false if there is no such job
+        bool kill(uint64_t number);
+
+        // Waits until the job (every job for 0) is finished, false if there is no such job
+        bool wait(uint64_t number);
+
+    private:
+        mutable std::mutex listMutex;
+        std::condition_variable finished;
+        vector<shared_ptr<Job> > jobs;
+        uint64_t nextNumber = 1;
+    };
+
+    // Runs the jobs of every session on a fixed number of threads. Jobs that are still queued or running when the
+    // pool is destroyed are killed.
+    class JobPool {
+    public:
+        explicit JobPool(size_t threadCount);
+        ~JobPool();
+        JobPool(const JobPool&) = delete;
+        JobPool& operator=(const JobPool&) = delete;
+
+        // Queues the job, run writes the output of the job to the stream it is given
+        void submit(const shared_ptr<JobList>& list, const shared_ptr<Job>& job,
+                    std::function<void(std::ostream&)> run);
+
+    private:
+        struct Task {
+            shared_ptr<JobList> list;
+            shared_ptr<Job> job;
+            std::function<void(std::ostream&)> run;
+        };
+
+        void work(size_t index);
+
+        std::mutex poolMutex;
+        std::condition_variable queued;
+        std::deque<Task> tasks;
+        // The job each worker is running, so that it can be killed when the pool is destroyed
+        vector<shared_ptr<Job> > running;
+        bool stopping = false;
+        vector<std::thread> workers;
+    };
+
+    // Lets long operations stop when the job they run for is killed. The flag belongs to the calling thread, so
+    // threads started for a job copy it from the thread that started them.
+    class JobControl {
+    public:
+        static void setFlag(const std::atomic<bool>* flag);
+
+        // The flag of the job the calling thread runs for, nullptr outside of jobs
+        static const std::atomic<bool>* flag();
+
+        static bool killed();
+
+        // Throws JobKilled if the job of the calling thread was killed
+        static void checkKilled();
+    };
+} //GTUShell namespace
+
+#endif //JOBS_H
@@ -0,0 +1,71 @@
+#include "LogWriter.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+namespace GTUShell {
+
+    namespace {
+        // Every log that was opened once, the logs live as long as the program
+        mutex writersMutex;
+        vector<LogWriter*> writers;
+    }
+
+    bool LogWriter::open(const string& path, const string& header, const string& separatorVal,
+                         const string& footerVal) {
+        {
+            lock_guard<mutex> lock(logMutex);
+            file.open(path, ios::trunc);
+            if (!file.is_open())
+                return false;
+            file << header;
+            pending.clear();
+            separator = separatorVal;
+            footer = footerVal;
+            firstEntry = true;
+            opened = true;
+        }
+
+        lock_guard<mutex> lock(writersMutex);
+        if (writers.empty())
+            atexit(closeAll);
+        for (LogWriter* writer : writers) {
+            if (writer == this)
+                return true;
+        }
+        writers.push_back(this);
+        return true;
+    }
+
+    void LogWriter::close() {
+        lock_guard<mutex> lock(logMutex);
+        if (!opened)
+            return;
+        opened = false;
+        file << pending << footer;
+        pending.clear();
+        file.close();
+    }
+
+    void LogWriter::add(const string& entry) {
+        lock_guard<mutex> lock(logMutex);
+        if (!opened)
+            return;
+        if (!firstEntry)
+            pending += separator;
+        pending += entry;
+        firstEntry = false;
+        if (pending.size() >= blockSize) {
+            file << pending;
+            pending.clear();
+        }
+    }
+
+    void LogWriter::closeAll() {
+        lock_guard<mutex> lock(writersMutex);
+        for (LogWriter* writer : writers)
+            writer->close();
+    }
+} //GTUShell namespace
@@ -0,0 +1,48 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace GTUShell {
+    // A log file that any thread adds entries to, written in blocks instead of one write per entry. The trace and
+    // the recorded sessions are written with it. Logs that are open are finished by closeAll, which also runs at exit.
+    class LogWriter {
+    public:
+        LogWriter() = default;
+        LogWriter(const LogWriter&) = delete;
+        LogWriter& operator=(const LogWriter&) = delete;
+
+        // Truncates the file and writes the header, false if the file can not be opened. Entries are joined with
+        // the separator and the footer ends the file.
+        bool open(const std::string& path, const std::string& header, const std::string& separatorVal = "",
+                  const std::string& footerVal = "");
+
+        // Writes the entries that are left and the footer
+        void close();
+
+        // True while the log is open. Only a relaxed load, so callers check it before they build an entry.
+        bool isOpen() const { return opened.load(std::memory_order_relaxed); }
+
+        // Adds the entry, nothing is written once the log is closed
+        void add(const std::string& entry);
+
+        // Closes every open log, for ends of the program that skip the exit handlers
+        static void closeAll();
+
+    private:
+        static const size_t blockSize = 64 * 1024;
+
+        std::mutex logMutex;
+        std::ofstream file;
+        std::string pending;
+        std::string separator;
+        std::string footer;
+        bool firstEntry = true;
+        std::atomic<bool> opened{false};
+    };
+} //GTUShell namespace
+
+#endif //LOGWRITER_H
@@ -0,0 +1,149 @@
+#include "LzCodec.h"
+#include "ShellExceptions.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace GTUShell {
+
+    namespace {
+        const size_t minMatch = 4;
+        const size_t maxOffset = 65535;
+        const int hashBits = 14;
+
+        // Matches are not started in the last bytes so that the last sequence always has literals
+        const size_t endLiterals = 5;
+
+        uint32_t read32(const char* data) {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        uint32_t hashOf(uint32_t value) {
+            return (value * 2654435761u) >> (32 - hashBits);
+        }
+
+        // Writes the part of a count that does not fit in the token
+        void writeCount(string& output, size_t count) {
+            while (count >= 255) {
+                output += static_cast<char>(255);
+                count -= 255;
+            }
+            output += static_cast<char>(count);
+        }
+
+        void writeSequence(string& output, const char* literals, size_t literalCount, size_t offset, size_t matchLength) {
+            size_t matchCode = matchLength ? matchLength - minMatch : 0;
+            unsigned char token = static_cast<unsigned char>((literalCount < 15 ? literalCount : 15) << 4);
+            token |= static_cast<unsigned char>(matchCode < 15 ? matchCode : 15);
+            output += static_cast<char>(token);
+
+            if (literalCount >= 15)
+                writeCount(output, literalCount - 15);
+            output.append(literals, literalCount);
+
+            if (matchLength == 0)
+                return;
+            output += static_cast<char>(offset & 0xFF);
+            output += static_cast<char>(offset >> 8);
+            if (matchCode >= 15)
+                writeCount(output, matchCode - 15);
+        }
+
+        size_t readCount(const string& input, size_t& pos, size_t count) {
+            if (count != 15)
+                return count;
+            while (true) {
+                if (pos >= input.size())
+                    throw ContentCorrupted();
+                unsigned char extra = static_cast<unsigned char>(input[pos++]);
+                count += extra;
+                if (extra != 255)
+                    return count;
+            }
+        }
+    }
+
+    string LzCodec::compress(const string& input) {
+        string output;
+        output.reserve(input.size() / 2 + 16);
+
+        const char* data = input.data();
+        size_t size = input.size();
+        size_t anchor = 0;
+        size_t pos = 0;
+
+        // Last position where each hashed 4 byte value was seen, plus one so that zero means empty
+        std::vector<uint32_t> table(size_t(1) << hashBits, 0);
+
+        while (pos + minMatch + endLiterals <= size) {
+            uint32_t value = read32(data + pos);
+            uint32_t& slot = table[hashOf(value)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(pos + 1);
+
+            if (candidate == 0 || pos - (candidate - 1) > maxOffset || read32(data + candidate - 1) != value) {
+                pos++;
+                continue;
+            }
+            candidate--;
+
+            // Extend the match as far as possible, keeping the last bytes as literals
+            size_t length = minMatch;
+            size_t limit = size - endLiterals;
+            while (pos + length < limit && data[candidate + length] == data[pos + length])
+                length++;
+
+            writeSequence(output, data + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        }
+
+        writeSequence(output, data + anchor, size - anchor, 0, 0);
+        return output;
+    }
+
+    string LzCodec::decompress(const string& input, size_t originalSize) {
+        string output;
+        output.reserve(originalSize);
+        size_t pos = 0;
+
+        while (pos < input.size()) {
+            unsigned char token = static_cast<unsigned char>(input[pos++]);
+
+            size_t literalCount = readCount(input, pos, token >> 4);
+            if (literalCount > input.size() - pos || output.size() + literalCount > originalSize)
+                throw ContentCorrupted();
+            output.append(input, pos, literalCount);
+            pos += literalCount;
+
+            // The last sequence ends right after its literals
+            if (pos == input.size())
+                break;
+
+            if (input.size() - pos < 2)
+                throw ContentCorrupted();
+            size_t offset = static_cast<unsigned char>(input[pos]) | (static_cast<unsigned char>(input[pos + 1]) << 8);
+            pos += 2;
+            size_t matchLength = readCount(input, pos, token & 0x0F) + minMatch;
+
+            if (offset == 0 || offset > output.size() || output.size() + matchLength > originalSize)
+                throw ContentCorrupted();
+
+            // A match that overlaps the bytes it produces has to be copied byte by byte
+            size_t from = output.size() - offset;
+            if (offset >= matchLength) {
+                output.append(output, from, matchLength);
+            } else {
+                for (size_t i = 0; i < matchLength; i++)
+                    output += output[from + i];
+            }
+        }
+
+        if (output.size() != originalSize)
+            throw ContentCorrupted();
+        return output;
+    }
+} //GTUShell namespace
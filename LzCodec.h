@@ -0,0 +1,26 @@
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include <string>
+
+using std::string;
+
+namespace GTUShell {
+    // A small LZ77 codec in the style of LZ4 that is used for the contents stored on the disk.
+    //
+    // The compressed data is a list of sequences:
+    //   token (literal count << 4 | match length - 4), extra literal count bytes, literals,
+    //   2 byte little endian match offset, extra match length bytes
+    // A count of 15 in the token is continued with bytes that are added until one is below 255.
+    // The last sequence only has literals.
+    class LzCodec {
+    public:
+        // Returns the compressed bytes, they can be longer than the input for incompressible data
+        static string compress(const string& input);
+
+        // Restores the original bytes, throws ContentCorrupted if the data does not decode to originalSize bytes
+        static string decompress(const string& input, size_t originalSize);
+    };
+} //GTUShell namespace
+
+#endif //LZCODEC_H
@@ -0,0 +1,80 @@
+#include "Mount.h"
+#include "Directory.h"
+
+#include <sstream>
+#include <unistd.h>
+
+namespace GTUShell {
+
+    Mount::Mount(const string& imagePathVal, const string& name, const DiskImage& settings)
+            : imagePath(imagePathVal), disk(std::make_shared<DiskImage>(imagePathVal)) {
+        disk->useSettingsOf(settings);
+
+        // A new image starts with the record of its root, like the disk.txt the shell creates
+        if (access(imagePath.c_str(), F_OK) != 0) {
+            disk->append(Directory::rootRecord());
+            disk->sync();
+        } else {
+            // A file that is not an image is refused here, not the first time the mount point is used
+            disk->checkImage();
+        }
+
+        FileData rootData = Directory::rootRecord();
+        rootData.name = name;
+        root = static_cast<Directory*>(arena.createEntry(name, arena.inodes().create(rootData, InodeTable::rootNumber),
+                                                         disk));
+        root->setMount(this);
+    }
+
+    const string& Mount::getImagePath() const {
+        return imagePath;
+    }
+
+    NodeArena& Mount::getArena() {
+        return arena;
+    }
+
+    DiskImage& Mount::getDisk() {
+        return *disk;
+    }
+
+    Directory& Mount::getRoot() {
+        return *root;
+    }
+
+    bool Mount::isLoaded() const {
+        return loaded.load(std::memory_order_acquire);
+    }
+
+    void Mount::load() {
+        if (isLoaded())
+            return;
+
+        std::lock_guard<std::recursive_mutex> lock(loadMutex);
+        if (loaded || loading)
+            return;
+        loading = true;
+        std::ostringstream loadMessages;
+        try {
+            root->readDiskFile(loadMessages);
+            messages += loadMessages.str();
+        } catch (const ShellExceptions& err) {
+            // The mount stays unloaded and the next use tries again, the error names the image it came from
+            loading = false;
+            messages += loadMessages.str();
+            throw ImageUnreadable(imagePath, err.what());
+        } catch (...) {
+            loading = false;
+            throw;
+        }
+        loading = false;
+        loaded.store(true, std::memory_order_release);
+    }
+
+    string Mount::takeMessages() {
+        std::lock_guard<std::recursive_mutex> lock(loadMutex);
+        string taken;
+        taken.swap(messages);
+        return taken;
+    }
+} //GTUShell namespace
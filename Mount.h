@@ -0,0 +1,58 @@
+#ifndef MOUNT_H
+#define MOUNT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "DiskImage.h"
+#include "NodeArena.h"
+
+namespace GTUShell {
+    class Directory;
+
+    // A disk image mounted at a directory of the tree. The nodes of the image are kept in an arena of their own, so
+    // its inode numbers never mix with the ones of other images, and the image is only read the first time the
+    // children of the mount point are used.
+    class Mount {
+    public:
+        // Creates the mount point with the name. A missing image is created empty, of an existing one only the
+        // manifest and the first record header are checked (see DiskImage::checkImage).
+        // The disk takes the settings (durability, compression, segment size and quota) of the given disk.
+        Mount(const string& imagePathVal, const string& name, const DiskImage& settings);
+        Mount(const Mount&) = delete;
+        Mount& operator=(const Mount&) = delete;
+
+        const string& getImagePath() const;
+        NodeArena& getArena();
+        DiskImage& getDisk();
+
+        // The mount point, the root directory of the image
+        Directory& getRoot();
+
+        bool isLoaded() const;
+
+        // Reads the image into the mount point once. Readers that hold the tree for reading can call it at the same
+        // time, the first one reads while the others wait. Calls made while the image is read return right away.
+        // Throws ImageUnreadable when the image can not be read, the mount point is left unloaded.
+        void load();
+
+        // Returns the messages about damaged records of the load and forgets them. The load runs inside whatever
+        // reads the mount point first, so the shell reports them after the line.
+        string takeMessages();
+
+    private:
+        string imagePath;
+        // Declared first, so the nodes are destroyed after everything that refers to them
+        NodeArena arena;
+        shared_ptr<DiskImage> disk;
+        Directory* root;
+
+        std::recursive_mutex loadMutex;
+        bool loading = false;
+        std::atomic<bool> loaded{false};
+        string messages;
+    };
+} //GTUShell namespace
+
+#endif //MOUNT_H
@@ -0,0 +1,122 @@
+#include "NodeArena.h"
+#include "Directory.h"
+#include "RegularFile.h"
+#include "SoftLinkedFile.h"
+
+namespace GTUShell {
+
+    NodeArena::NodeArena()
+            : regularFiles(new ObjectPool<RegularFile>()), softLinks(new ObjectPool<SoftLinkedFile>()),
+              directories(new ObjectPool<Directory>()) { }
+
+    NodeArena::~NodeArena() {
+        // Every node is destroyed once from its slot, without following the children of directories
+        for (auto& slot : slots) {
+            if (slot.node)
+                destroy(slot.node);
+        }
+    }
+
+    File* NodeArena::createEntry(const string& name, Inode* inode, const shared_ptr<DiskImage>& disk) {
+        File* node;
+        switch (inode->type) {
+            case 'D': {
+                Directory* dir = directories->create();
+                dir->setDisk(disk);
+                dir->setArena(this);
+                node = dir;
+                break;
+            }
+            case 'S':
+                node = softLinks->create();
+                break;
+            default:
+                node = regularFiles->create();
+                break;
+        }
+        node->setEntry(name, inode);
+        assignHandle(node);
+        return node;
+    }
+
+    File* NodeArena::create(FileData data, const shared_ptr<DiskImage>& disk) {
+        string name = data.name;
+        return createEntry(name, inodeTable.create(std::move(data)), disk);
+    }
+
+    InodeTable& NodeArena::inodes() {
+        return inodeTable;
+    }
+
+    const InodeTable& NodeArena::inodes() const {
+        return inodeTable;
+    }
+
+    File* NodeArena::get(NodeHandle handle) const {
+        if (handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+            return nullptr;
+        return slots[handle.index].node;
+    }
+
+    Directory* NodeArena::directory(NodeHandle handle) const {
+        File* node = get(handle);
+        // The type is the tag of the node, no RTTI is needed to find directories
+        return (node && node->getType() == 'D') ? static_cast<Directory*>(node) : nullptr;
+    }
+
+    void NodeArena::release(File* node) {
+        if (node->getType() == 'D') {
+            for (File* child : static_cast<Directory*>(node)->getFiles())
+                release(child);
+        }
+
+        Slot& slot = slots[node->handle.index];
+        slot.node = nullptr;
+        slot.generation++;
+        freeSlots.push_back(node->handle.index);
+        inodeTable.unlink(node->inode);
+        destroy(node);
+    }
+
+    size_t NodeArena::size() const {
+        return liveNodes;
+    }
+
+    void NodeArena::entriesChanged() {
+        entryChanges.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t NodeArena::entryGeneration() const {
+        return entryChanges.load(std::memory_order_acquire);
+    }
+
+    void NodeArena::assignHandle(File* node) {
+        uint32_t index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+
+        slots[index].node = node;
+        node->handle = { index, slots[index].generation };
+        liveNodes++;
+    }
+
+    void NodeArena::destroy(File* node) {
+        liveNodes--;
+        switch (node->getType()) {
+            case 'D':
+                directories->destroy(static_cast<Directory*>(node));
+                break;
+            case 'S':
+                softLinks->destroy(static_cast<SoftLinkedFile*>(node));
+                break;
+            default:
+                regularFiles->destroy(static_cast<RegularFile*>(node));
+                break;
+        }
+    }
+} //GTUShell namespace
@@ -0,0 +1,83 @@
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "File.h"
+#include "Inode.h"
+#include "ObjectPool.h"
+
+namespace GTUShell {
+    class Directory;
+    class DiskImage;
+    class RegularFile;
+    class SoftLinkedFile;
+
+    // Owns the nodes (directory entries) of a tree and the inodes they refer to. Nodes are placed in chunks of their
+    // type instead of one heap allocation each, and a node stays at the same address until it is released, so
+    // directories refer to their children with plain pointers. Nodes are created and released while the tree is
+    // locked for writing.
+    class NodeArena {
+    public:
+        NodeArena();
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+        ~NodeArena();
+
+        // Creates an entry with the name that refers to the inode, the node has the type of the inode
+        File* createEntry(const string& name, Inode* inode, const shared_ptr<DiskImage>& disk);
+
+        // Creates a new inode from the data and an entry with the name of the data for it
+        File* create(FileData data, const shared_ptr<DiskImage>& disk);
+
+        // The inodes the entries of the tree refer to
+        InodeTable& inodes();
+        const InodeTable& inodes() const;
+
+        // Returns the node of the handle, nullptr if it has been released
+        File* get(NodeHandle handle) const;
+
+        // Returns the node of the handle if it is a directory, nullptr otherwise
+        Directory* directory(NodeHandle handle) const;
+
+        // Destroys the node, a directory is destroyed together with every node inside it. The inode of the node
+        // loses a link.
+        void release(File* node);
+
+        // Number of nodes that are alive
+        size_t size() const;
+
+        // Changes whenever an entry of the tree is added, removed or renamed, so a path resolved while it stays the
+        // same still leads to the same node
+        void entriesChanged();
+        uint64_t entryGeneration() const;
+
+    private:
+        struct Slot {
+            File* node = nullptr;
+            uint32_t generation = 0;
+        };
+
+        vector<Slot> slots;
+        vector<uint32_t> freeSlots;
+        size_t liveNodes = 0;
+        // Mounted images are loaded by readers, so it is atomic
+        std::atomic<uint64_t> entryChanges{0};
+
+        // Declared after the slots, so the pools are destroyed after the destructor has emptied them
+        std::unique_ptr<ObjectPool<RegularFile> > regularFiles;
+        std::unique_ptr<ObjectPool<SoftLinkedFile> > softLinks;
+        std::unique_ptr<ObjectPool<Directory> > directories;
+
+        InodeTable inodeTable;
+
+        // Gives the node a slot and stores its handle in it
+        void assignHandle(File* node);
+        void destroy(File* node);
+    };
+} //GTUShell namespace
+
+#endif //NODEARENA_H
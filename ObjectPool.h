@@ -0,0 +1,48 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace GTUShell {
+    // Fixed-size chunks of uninitialized objects and a free list of released ones. Objects stay at the same
+    // address until they are destroyed.
+    template<typename T>
+    class ObjectPool {
+    public:
+        template<typename... Args>
+        T* create(Args&&... args) {
+            void* memory;
+            if (!freeList.empty()) {
+                memory = freeList.back();
+                freeList.pop_back();
+            } else {
+                if (chunks.empty() || usedInChunk == chunkSize) {
+                    chunks.emplace_back(new Storage[chunkSize]);
+                    usedInChunk = 0;
+                }
+                memory = &chunks.back()[usedInChunk++];
+            }
+            return new (memory) T(std::forward<Args>(args)...);
+        }
+
+        void destroy(T* object) {
+            object->~T();
+            freeList.push_back(object);
+        }
+
+    private:
+        static const size_t chunkSize = 4096;
+        using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+        std::vector<std::unique_ptr<Storage[]> > chunks;
+        size_t usedInChunk = 0;
+        std::vector<void*> freeList;
+    };
+} //GTUShell namespace
+
+#endif //OBJECTPOOL_H
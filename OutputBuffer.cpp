@@ -0,0 +1,75 @@
+#include "OutputBuffer.h"
+
+#include <charconv>
+
+#include "Timestamp.h"
+
+using namespace std;
+
+namespace GTUShell {
+    OutputBuffer::OutputBuffer(std::ostream& outVal, size_t blockSizeVal) : out(outVal), blockSize(blockSizeVal) {
+        // Room for a full block and the row that fills it
+        buffer.reserve(blockSize + 4096);
+    }
+
+    OutputBuffer::~OutputBuffer() {
+        flush();
+    }
+
+    void OutputBuffer::addPadded(const string& text, size_t width) {
+        buffer += text;
+        if (text.size() < width)
+            buffer.append(width - text.size(), ' ');
+        flushIfFull();
+    }
+
+    void OutputBuffer::addPadded(char c, size_t width) {
+        buffer += c;
+        if (width > 1)
+            buffer.append(width - 1, ' ');
+        flushIfFull();
+    }
+
+    void OutputBuffer::addNumber(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr - digits);
+        flushIfFull();
+    }
+
+    void OutputBuffer::addDate(int64_t time) {
+        if (!hasLastDate || time != lastTime) {
+            hasLastDate = true;
+            lastTime = time;
+            lastDateLength = Timestamp::format(time, lastDate);
+        }
+        buffer.append(lastDate, lastDateLength);
+        flushIfFull();
+    }
+
+    void OutputBuffer::addJson(const string& text) {
+        static const char hex[] = "0123456789abcdef";
+        buffer += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                buffer += '\\';
+                buffer += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                buffer.append("\\u00");
+                buffer += hex[c >> 4];
+                buffer += hex[c & 0xF];
+            } else {
+                buffer += c;
+            }
+        }
+        buffer += '"';
+        flushIfFull();
+    }
+
+    void OutputBuffer::flush() {
+        if (buffer.empty())
+            return;
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+} //GTUShell namespace
@@ -0,0 +1,74 @@
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace GTUShell {
+    // Collects output in one buffer and writes it to the stream in large blocks. Text is padded and numbers are
+    // formatted by hand instead of through the formatting of the stream, so adding a row allocates nothing once the
+    // buffer has its block size.
+    class OutputBuffer {
+    public:
+        explicit OutputBuffer(std::ostream& outVal, size_t blockSizeVal = 64 * 1024);
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+        // Writes what is left
+        ~OutputBuffer();
+
+        void add(char c) {
+            buffer += c;
+            flushIfFull();
+        }
+
+        void add(const char* text, size_t length) {
+            buffer.append(text, length);
+            flushIfFull();
+        }
+
+        void add(const char* text) {
+            add(text, std::strlen(text));
+        }
+
+        void add(const std::string& text) {
+            add(text.data(), text.size());
+        }
+
+        // Adds the text followed by spaces up to the width, like std::left with std::setw
+        void addPadded(const std::string& text, size_t width);
+        void addPadded(char c, size_t width);
+
+        void addNumber(long long value);
+
+        // Adds a date in the format of Timestamp
+        void addDate(int64_t time);
+
+        // Adds the text as a quoted JSON string
+        void addJson(const std::string& text);
+
+        // Writes the buffer to the stream
+        void flush();
+
+    private:
+        std::ostream& out;
+        size_t blockSize;
+        std::string buffer;
+
+        // Rows of a listing mostly share their dates, the last one is formatted only once
+        bool hasLastDate = false;
+        int64_t lastTime = 0;
+        char lastDate[24];
+        size_t lastDateLength = 0;
+
+        void flushIfFull() {
+            if (buffer.size() >= blockSize)
+                flush();
+        }
+    };
+} //GTUShell namespace
+
+#endif //OUTPUTBUFFER_H
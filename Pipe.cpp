@@ -0,0 +1,116 @@
+#include "Pipe.h"
+
+#include <algorithm>
+
+namespace GTUShell {
+
+    bool Pipe::write(const char* data, size_t size) {
+        std::unique_lock<std::mutex> lock(pipeMutex);
+        while (size > 0) {
+            changed.wait(lock, [this] { return readerClosed || count < buffer.size(); });
+            if (readerClosed)
+                return false;
+
+            // Copy as much as fits after the last byte in the ring
+            size_t tail = (head + count) % buffer.size();
+            size_t amount = std::min(size, std::min(buffer.size() - count, buffer.size() - tail));
+            std::copy(data, data + amount, buffer.begin() + tail);
+            count += amount;
+            data += amount;
+            size -= amount;
+            changed.notify_all();
+        }
+        return true;
+    }
+
+    size_t Pipe::read(char* data, size_t size) {
+        std::unique_lock<std::mutex> lock(pipeMutex);
+        changed.wait(lock, [this] { return writerClosed || count > 0; });
+
+        size_t amount = std::min(size, std::min(count, buffer.size() - head));
+        std::copy(buffer.begin() + head, buffer.begin() + head + amount, data);
+        head = (head + amount) % buffer.size();
+        count -= amount;
+        changed.notify_all();
+        return amount;
+    }
+
+    void Pipe::closeWriter() {
+        std::lock_guard<std::mutex> lock(pipeMutex);
+        writerClosed = true;
+        changed.notify_all();
+    }
+
+    void Pipe::closeReader() {
+        std::lock_guard<std::mutex> lock(pipeMutex);
+        readerClosed = true;
+        changed.notify_all();
+    }
+
+    PipeWriteBuffer::PipeWriteBuffer(Pipe& pipeVal) : pipe(pipeVal) {
+        setp(chunk, chunk + sizeof(chunk));
+    }
+
+    PipeWriteBuffer::~PipeWriteBuffer() {
+        sync();
+        pipe.closeWriter();
+    }
+
+    PipeWriteBuffer::int_type PipeWriteBuffer::overflow(int_type ch) {
+        if (sync() != 0)
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int PipeWriteBuffer::sync() {
+        size_t size = pptr() - pbase();
+        setp(chunk, chunk + sizeof(chunk));
+
+        // Once the reader is gone the stream fails, so the stage stops producing output
+        return (size == 0 || pipe.write(chunk, size)) ? 0 : -1;
+    }
+
+    ChunkWriteBuffer::ChunkWriteBuffer(size_t chunkSizeVal) : chunkSize(chunkSizeVal), chunk(chunkSizeVal, '\0') {
+        setp(&chunk[0], &chunk[0] + chunk.size());
+    }
+
+    std::vector<std::string> ChunkWriteBuffer::takeChunks() {
+        // The chunk is handed over as it is, only its unused end is cut off
+        chunk.resize(pptr() - pbase());
+        if (!chunk.empty())
+            chunks.push_back(std::move(chunk));
+        chunk.assign(chunkSize, '\0');
+        setp(&chunk[0], &chunk[0] + chunk.size());
+
+        std::vector<std::string> taken;
+        taken.swap(chunks);
+        return taken;
+    }
+
+    ChunkWriteBuffer::int_type ChunkWriteBuffer::overflow(int_type ch) {
+        chunks.push_back(std::move(chunk));
+        chunk.assign(chunkSize, '\0');
+        setp(&chunk[0], &chunk[0] + chunk.size());
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    PipeReadBuffer::~PipeReadBuffer() {
+        pipe.closeReader();
+    }
+
+    PipeReadBuffer::int_type PipeReadBuffer::underflow() {
+        size_t size = pipe.read(chunk, sizeof(chunk));
+        if (size == 0)
+            return traits_type::eof();
+        setg(chunk, chunk, chunk + size);
+        return traits_type::to_int_type(chunk[0]);
+    }
+} //GTUShell namespace
@@ -0,0 +1,85 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace GTUShell {
+    // A bounded byte queue between two stages of a pipeline. The writer blocks while it is full and the reader
+    // blocks while it is empty, so a pipeline never holds more than the capacity of its pipes.
+    class Pipe {
+    public:
+        explicit Pipe(size_t capacity = 64 * 1024) : buffer(capacity) { }
+
+        // Copies all of the bytes into the pipe, returns false if the reader has stopped reading
+        bool write(const char* data, size_t size);
+
+        // Copies at most size bytes out of the pipe, returns 0 once the writer is closed and the pipe is empty
+        size_t read(char* data, size_t size);
+
+        // Called by each side when it is done, so that the other side does not wait forever
+        void closeWriter();
+        void closeReader();
+
+    private:
+        std::mutex pipeMutex;
+        std::condition_variable changed;
+        std::vector<char> buffer;
+        size_t head = 0;
+        size_t count = 0;
+        bool writerClosed = false;
+        bool readerClosed = false;
+    };
+
+    // Stream buffer that writes into a pipe in chunks, so that stages can use an std::ostream
+    class PipeWriteBuffer : public std::streambuf {
+    public:
+        explicit PipeWriteBuffer(Pipe& pipeVal);
+        ~PipeWriteBuffer() override;
+
+    protected:
+        int_type overflow(int_type ch) override;
+        int sync() override;
+
+    private:
+        Pipe& pipe;
+        char chunk[4096];
+    };
+
+    // Stream buffer that collects the output of a redirection in chunks, so the output is never copied into one
+    // string. The chunks are added to the file with Directory::appendChunks once the pipeline has ended.
+    class ChunkWriteBuffer : public std::streambuf {
+    public:
+        explicit ChunkWriteBuffer(size_t chunkSizeVal = 64 * 1024);
+
+        // The chunks written so far, the last one can be shorter
+        std::vector<std::string> takeChunks();
+
+    protected:
+        int_type overflow(int_type ch) override;
+
+    private:
+        size_t chunkSize;
+        std::vector<std::string> chunks;
+        std::string chunk;
+    };
+
+    // Stream buffer that reads from a pipe in chunks, so that stages can use an std::istream
+    class PipeReadBuffer : public std::streambuf {
+    public:
+        explicit PipeReadBuffer(Pipe& pipeVal) : pipe(pipeVal) { }
+        ~PipeReadBuffer() override;
+
+    protected:
+        int_type underflow() override;
+
+    private:
+        Pipe& pipe;
+        char chunk[4096];
+    };
+} //GTUShell namespace
+
+#endif //PIPE_H
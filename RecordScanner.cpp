@@ -0,0 +1,193 @@
+#include "RecordScanner.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RECORDSCANNER_X86
+#endif
+
+namespace GTUShell {
+
+    namespace {
+        RecordScanner::Level detectLevel() {
+#ifdef RECORDSCANNER_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return RecordScanner::Level::avx2;
+            if (__builtin_cpu_supports("sse2"))
+                return RecordScanner::Level::sse2;
+#endif
+            return RecordScanner::Level::scalar;
+        }
+
+        std::atomic<RecordScanner::Level> currentLevel{RecordScanner::bestLevel()};
+
+        // Stores the positions of the set bits of a block that starts at offset
+        inline void addTabs(uint32_t bits, size_t offset, size_t* tabs, size_t maxTabs, size_t& tabCount) {
+            while (bits) {
+                if (tabCount < maxTabs)
+                    tabs[tabCount] = offset + __builtin_ctz(bits);
+                tabCount++;
+                bits &= bits - 1;
+            }
+        }
+
+        size_t findNewlineScalar(const char* data, size_t from, size_t size) {
+            if (from >= size)
+                return size;
+            const void* found = memchr(data + from, '\n', size - from);
+            return found ? static_cast<const char*>(found) - data : size;
+        }
+
+        size_t scanLineScalar(const char* data, size_t from, size_t size, size_t* tabs, size_t maxTabs,
+                              size_t& tabCount) {
+            for (size_t i = from; i < size; i++) {
+                if (data[i] == '\n')
+                    return i;
+                if (data[i] == '\t') {
+                    if (tabCount < maxTabs)
+                        tabs[tabCount] = i;
+                    tabCount++;
+                }
+            }
+            return size;
+        }
+
+#ifdef RECORDSCANNER_X86
+        __attribute__((target("sse2")))
+        size_t findNewlineSse2(const char* data, size_t from, size_t size) {
+            const __m128i newline = _mm_set1_epi8('\n');
+            size_t i = from;
+            for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+                if (bits)
+                    return i + __builtin_ctz(bits);
+            }
+            return findNewlineScalar(data, i, size);
+        }
+
+        __attribute__((target("sse2")))
+        size_t scanLineSse2(const char* data, size_t from, size_t size, size_t* tabs, size_t maxTabs,
+                            size_t& tabCount) {
+            const __m128i newline = _mm_set1_epi8('\n');
+            const __m128i tab = _mm_set1_epi8('\t');
+            size_t i = from;
+            for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                uint32_t newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+                uint32_t tabBits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)));
+                if (newlines) {
+                    // Only the tabs before the new line belong to the line
+                    addTabs(tabBits & ((newlines & -newlines) - 1), i, tabs, maxTabs, tabCount);
+                    return i + __builtin_ctz(newlines);
+                }
+                addTabs(tabBits, i, tabs, maxTabs, tabCount);
+            }
+            return scanLineScalar(data, i, size, tabs, maxTabs, tabCount);
+        }
+
+        __attribute__((target("avx2")))
+        size_t findNewlineAvx2(const char* data, size_t from, size_t size) {
+            const __m256i newline = _mm256_set1_epi8('\n');
+            size_t i = from;
+            // Two blocks per step, the loop is bound by the loads
+            for (; i + 64 <= size; i += 64) {
+                __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+                __m256i either = _mm256_or_si256(_mm256_cmpeq_epi8(first, newline), _mm256_cmpeq_epi8(second, newline));
+                if (_mm256_testz_si256(either, either))
+                    continue;
+                uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(first, newline)));
+                if (bits)
+                    return i + __builtin_ctz(bits);
+                bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(second, newline)));
+                return i + 32 + __builtin_ctz(bits);
+            }
+            for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+                if (bits)
+                    return i + __builtin_ctz(bits);
+            }
+            return findNewlineSse2(data, i, size);
+        }
+
+        __attribute__((target("avx2")))
+        size_t scanLineAvx2(const char* data, size_t from, size_t size, size_t* tabs, size_t maxTabs,
+                            size_t& tabCount) {
+            const __m256i newline = _mm256_set1_epi8('\n');
+            const __m256i tab = _mm256_set1_epi8('\t');
+            size_t i = from;
+            for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                uint32_t newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+                uint32_t tabBits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)));
+                if (newlines) {
+                    addTabs(tabBits & ((newlines & -newlines) - 1), i, tabs, maxTabs, tabCount);
+                    return i + __builtin_ctz(newlines);
+                }
+                addTabs(tabBits, i, tabs, maxTabs, tabCount);
+            }
+            return scanLineSse2(data, i, size, tabs, maxTabs, tabCount);
+        }
+#endif
+    }
+
+    RecordScanner::Level RecordScanner::bestLevel() {
+        static const Level best = detectLevel();
+        return best;
+    }
+
+    RecordScanner::Level RecordScanner::level() {
+        return currentLevel.load(std::memory_order_relaxed);
+    }
+
+    void RecordScanner::setLevel(Level levelVal) {
+        currentLevel = static_cast<int>(levelVal) > static_cast<int>(bestLevel()) ? bestLevel() : levelVal;
+    }
+
+    const char* RecordScanner::nameOf(Level levelVal) {
+        switch (levelVal) {
+            case Level::avx2:
+                return "avx2";
+            case Level::sse2:
+                return "sse2";
+            default:
+                return "scalar";
+        }
+    }
+
+    size_t RecordScanner::findNewline(const char* data, size_t from, size_t size) {
+#ifdef RECORDSCANNER_X86
+        switch (level()) {
+            case Level::avx2:
+                return findNewlineAvx2(data, from, size);
+            case Level::sse2:
+                return findNewlineSse2(data, from, size);
+            default:
+                break;
+        }
+#endif
+        return findNewlineScalar(data, from, size);
+    }
+
+    size_t RecordScanner::scanLine(const char* data, size_t from, size_t size, size_t* tabs, size_t maxTabs,
+                                   size_t& tabCount) {
+        tabCount = 0;
+#ifdef RECORDSCANNER_X86
+        switch (level()) {
+            case Level::avx2:
+                return scanLineAvx2(data, from, size, tabs, maxTabs, tabCount);
+            case Level::sse2:
+                return scanLineSse2(data, from, size, tabs, maxTabs, tabCount);
+            default:
+                break;
+        }
+#endif
+        return scanLineScalar(data, from, size, tabs, maxTabs, tabCount);
+    }
+} //GTUShell namespace
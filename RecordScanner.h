@@ -0,0 +1,32 @@
+#ifndef RECORDSCANNER_H
+#define RECORDSCANNER_H
+
+#include <cstddef>
+
+namespace GTUShell {
+    // Finds the tabs and new lines that split the records of a segment (see DiskImage), 16 bytes at a time with
+    // SSE2 or 32 with AVX2. The best level the CPU has is picked on the first use, other CPUs use memchr
+    // and a byte loop.
+    class RecordScanner {
+    public:
+        enum class Level { scalar, sse2, avx2 };
+
+        // The level that is used, the best one the CPU has unless setLevel chose a lower one
+        static Level level();
+        static Level bestLevel();
+
+        // Uses a lower level, for the benchmarks. A level the CPU does not have is lowered to the best one.
+        static void setLevel(Level level);
+        static const char* nameOf(Level level);
+
+        // Position of the first new line at or after from, size if there is none
+        static size_t findNewline(const char* data, size_t from, size_t size);
+
+        // Finds the first new line at or after from like findNewline and the tabs before it. The positions of the
+        // first maxTabs tabs are stored in tabs, tabCount is the number of tabs in the line (it can be larger).
+        static size_t scanLine(const char* data, size_t from, size_t size, size_t* tabs, size_t maxTabs,
+                               size_t& tabCount);
+    };
+} //GTUShell namespace
+
+#endif //RECORDSCANNER_H
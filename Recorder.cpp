@@ -0,0 +1,45 @@
+#include "Recorder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+#include "DiskImage.h"
+
+using namespace std;
+
+namespace GTUShell {
+    LogWriter Recorder::log;
+
+    namespace {
+        chrono::steady_clock::time_point epoch;
+    }
+
+    bool Recorder::start(const string& path, const DiskImage& disk) {
+        char crc[9];
+        snprintf(crc, sizeof(crc), "%08x", disk.imageChecksum());
+        ostringstream header;
+        header << "image\t" << disk.getPath() << "\t" << crc << "\n"
+               << "settings\t" << disk.isDurable() << "\t" << disk.usesCompression() << "\t" << disk.getQuota() << "\t"
+               << (disk.getQuotaMode() == DiskImage::QuotaMode::logical ? "logical" : "physical") << "\t"
+               << disk.getSegmentSize() << "\n";
+
+        // The image is copied before the log is open, so no line is recorded before the copy
+        disk.copyImage(imagePath(path));
+        epoch = chrono::steady_clock::now();
+        return log.open(path, header.str());
+    }
+
+    void Recorder::stop() {
+        log.close();
+    }
+
+    void Recorder::record(uint64_t session, const string& line) {
+        int64_t now = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+        log.add(to_string(now) + "\t" + to_string(session) + "\t" + line + "\n");
+    }
+
+    string Recorder::imagePath(const string& logPath) {
+        return logPath + ".image";
+    }
+} //GTUShell namespace
@@ -0,0 +1,39 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <string>
+
+#include "LogWriter.h"
+
+namespace GTUShell {
+    class DiskImage;
+
+    // Writes the command lines of every session to a log that ./replay runs again. The log starts with the checksum
+    // and the settings of the image, and a copy of the image is kept next to it (<log>.image), so a replay starts
+    // from the same files. Lines are:
+    //   image\t<path>\t<crc>
+    //   settings\t<durable>\t<compression>\t<quota bytes>\t<physical|logical>\t<segment bytes>
+    //   <microseconds since the start>\t<session>\t<command line>
+    class Recorder {
+    public:
+        // Starts the log, the disk must not have been loaded yet. False if the log can not be opened. The log is
+        // finished by stop, which also runs at exit.
+        static bool start(const std::string& path, const DiskImage& disk);
+        static void stop();
+
+        // True while a log is being written, a relaxed load like Trace::enabled
+        static bool enabled() { return log.isOpen(); }
+
+        // Adds a command line of the session
+        static void record(uint64_t session, const std::string& line);
+
+        // Name of the copy of the image that belongs to the log
+        static std::string imagePath(const std::string& logPath);
+
+    private:
+        static LogWriter log;
+    };
+} //GTUShell namespace
+
+#endif //RECORDER_H
@@ -1,12 +1,13 @@
 #include "RegularFile.h"
+#include "Inode.h"
 
 namespace GTUShell {
     File::iterator RegularFile::begin() const {
-        return data.content.begin();
+        return inode->begin();
     }
 
     File::iterator RegularFile::end() const {
-        return data.content.end();
+        return inode->end();
     }
 
 
@@ -7,9 +7,8 @@ namespace GTUShell {
     class RegularFile : public File {
     public:
         RegularFile() = default;
-        explicit RegularFile(const FileData& dataVal) : File(dataVal) { }
 
-        // Iterator overrides
+        // Iterator overrides, the content of the inode is walked
         iterator begin() const override;
         iterator end() const override;
 
@@ -0,0 +1,1169 @@
+#include "Shell.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Inode.h"
+#include "Pipe.h"
+#include "Recorder.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace GTUShell {
+
+    Shell::Shell(const string& diskPath) : disk(make_shared<DiskImage>(diskPath)) {
+        // Create an unordered map to check for the command input
+        commandMap = {
+                {"ls", Commands::ls},
+                {"mkdir", Commands::mkdir},
+                {"rm", Commands::rm},
+                {"cp", Commands::cp},
+                {"link", Commands::link},
+                {"cd", Commands::cd},
+                {"cat", Commands::cat},
+                {"rmdir", Commands::rmdir},
+                {"sync", Commands::sync},
+                {"grep", Commands::grep},
+                {"import", Commands::import},
+                {"export", Commands::exportTree},
+                {"ln", Commands::ln},
+                {"mv", Commands::mv},
+                {"stat", Commands::stat},
+                {"write", Commands::write},
+                {"append", Commands::append},
+                {"mount", Commands::mount},
+                {"umount", Commands::umount},
+                {"jobs", Commands::jobs},
+                {"wait", Commands::wait},
+                {"kill", Commands::kill}
+        };
+
+        // Set up the data for the root directory
+        FileData rootData = {
+                'D', ".", "/", "0", 0, ""
+        };
+        root.setEntry(".", arena.inodes().create(rootData, InodeTable::rootNumber));
+        root.setDisk(disk);
+        root.setArena(&arena);
+    }
+
+    Shell::~Shell() {
+        // Running jobs are killed and waited for, queued ones never start
+        jobPool.reset();
+        try {
+            syncDisks();
+        } catch (const ShellExceptions& err) {
+            cout << err.what() << "\n";
+        }
+    }
+
+    DiskImage& Shell::getDisk() {
+        return *disk;
+    }
+
+    void Shell::sync() {
+        shared_lock<shared_mutex> lock(treeMutex);
+        syncDisks();
+    }
+
+    void Shell::syncDisks() {
+        disk->sync();
+        for (const auto& mount : mounts)
+            mount.second->getDisk().sync();
+    }
+
+    void Shell::checkDiskSizes() {
+        disk->checkDiskSize();
+        shared_lock<shared_mutex> lock(treeMutex);
+        // An image that was not read has not been written either
+        for (const auto& mount : mounts) {
+            if (mount.second->isLoaded())
+                mount.second->getDisk().checkDiskSize();
+        }
+    }
+
+    uint64_t Shell::mountIdOf(const Directory& dir) const {
+        for (const auto& mount : mounts) {
+            if (dir.getArena() == &mount.second->getArena())
+                return mount.first;
+        }
+        return 0;
+    }
+
+    Directory* Shell::asDirectory(File* found) {
+        if (found->getParent() && found->getInode() == found->getParent()->getInode())
+            return found->getParent();
+        return static_cast<Directory*>(found);
+    }
+
+    void Shell::load(std::ostream& messages) {
+        unique_lock<shared_mutex> lock(treeMutex);
+        root.readDiskFile(messages);
+    }
+
+    string Shell::prompt(const Session& session) {
+        return session.currentPath + " > ";
+    }
+
+    bool Shell::isMutating(Commands command) {
+        switch (command) {
+            case Commands::mkdir:
+            case Commands::rm:
+            case Commands::rmdir:
+            case Commands::cp:
+            case Commands::link:
+            case Commands::import:
+            case Commands::ln:
+            case Commands::mv:
+            case Commands::write:
+            case Commands::append:
+            case Commands::mount:
+            case Commands::umount:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    Directory& Shell::findDirectory(Session& session) {
+        if (!session.directory)
+            return root;
+
+        // The handle is resolved without walking the path, in the arena of the image the directory is on
+        Directory* current = nullptr;
+        if (session.mount == 0) {
+            current = arena.directory(session.directory);
+        } else {
+            auto mountIt = mounts.find(session.mount);
+            if (mountIt != mounts.end())
+                current = mountIt->second->getArena().directory(session.directory);
+        }
+        if (!current) {
+            // The directory was removed or unmounted by another session, continue from the root
+            session.currentPath = "/";
+            session.directory = NodeHandle();
+            session.mount = 0;
+            return root;
+        }
+        if (session.moves != moves) {
+            session.currentPath = current->getPath();
+            session.moves = moves;
+        }
+        return *current;
+    }
+
+    bool Shell::readsInput(const Stage& stage) {
+        // cat without a file name copies its input, grep without a file name filters it
+        return (stage.command == Commands::cat && stage.words.size() < 2) ||
+               (stage.command == Commands::grep && stage.words.size() < 3);
+    }
+
+    bool Shell::parsePipeline(const string& inputStr, vector<Stage>& stages, string& target, bool& append,
+                              std::ostream& out) const {
+        // Split the line into words, | > and >> are words of their own even without spaces around them
+        vector<string> tokens;
+        string word;
+        for (size_t i = 0; i < inputStr.size(); i++) {
+            char c = inputStr[i];
+            if (c == ' ' || c == '\t' || c == '|' || c == '>') {
+                if (!word.empty())
+                    tokens.push_back(word);
+                word.clear();
+
+                if (c == '|') {
+                    tokens.emplace_back("|");
+                } else if (c == '>' && i + 1 < inputStr.size() && inputStr[i + 1] == '>') {
+                    tokens.emplace_back(">>");
+                    i++;
+                } else if (c == '>') {
+                    tokens.emplace_back(">");
+                }
+            } else {
+                word += c;
+            }
+        }
+        if (!word.empty())
+            tokens.push_back(word);
+
+        stages.emplace_back();
+        for (size_t i = 0; i < tokens.size(); i++) {
+            const string& token = tokens[i];
+            if (token == ">" || token == ">>") {
+                // The redirection must be followed by exactly one file name at the end of the line
+                if (i + 2 != tokens.size() || tokens[i + 1] == "|" || tokens[i + 1][0] == '>') {
+                    out << "Syntax error near: " << token << "\n";
+                    return false;
+                }
+                target = tokens[i + 1];
+                append = (token == ">>");
+                if (target.find('/') != string::npos || target == "." || target == "..") {
+                    out << "Invalid file name: " << target << "\n";
+                    return false;
+                }
+                break;
+            }
+
+            if (token == "|") {
+                if (stages.back().words.empty()) {
+                    out << "Syntax error near: |\n";
+                    return false;
+                }
+                stages.emplace_back();
+            } else {
+                stages.back().words.push_back(token);
+            }
+        }
+
+        for (auto& stage : stages) {
+            if (stage.words.empty()) {
+                out << "Syntax error near: " << (target.empty() ? "|" : ">") << "\n";
+                return false;
+            }
+
+            // Make the command word lowercase
+            for (auto& c : stage.words[0])
+                c = tolower(c);
+
+            // If command map's end is reached, then the command does not exist in the map
+            auto commandIt = commandMap.find(stage.words[0]);
+            if (commandIt == commandMap.end()) {
+                out << "Command not found: " << stage.words[0] << "\n";
+                return false;
+            }
+            stage.command = commandIt->second;
+        }
+        return true;
+    }
+
+    void Shell::execute(Session& session, const string& inputStr, std::ostream& out) {
+        // Lines of jobs are recorded with the line that started them
+        if (Recorder::enabled() && !JobControl::flag() && inputStr.find_first_not_of(' ') != string::npos)
+            Recorder::record(session.id, inputStr);
+
+        // Jobs that finished since the last line are reported first, a job does not report the jobs of its session
+        bool jobFailed = session.jobs && !JobControl::flag() && session.jobs->report(out);
+        try {
+            runLine(session, inputStr, out);
+        } catch (const ImageUnreadable& err) {
+            // A mounted image is read the first time it is used, one that can not be read only fails the line
+            out << err.what() << "\n";
+        }
+        if (mountCount.load(std::memory_order_relaxed) > 0)
+            reportMountMessages(out);
+
+        // A job that took a disk over its quota is handled like a foreground command that did, once the line ran
+        if (jobFailed)
+            checkDiskSizes();
+    }
+
+    void Shell::reportMountMessages(std::ostream& out) {
+        shared_lock<shared_mutex> lock(treeMutex);
+        for (const auto& mount : mounts)
+            out << mount.second->takeMessages();
+    }
+
+    void Shell::runLine(Session& session, const string& inputStr, std::ostream& out) {
+        // Check if inputStr is empty or it only has whitespaces
+        if(inputStr.empty() || inputStr.find_first_not_of(' ') == std::string::npos)
+            return;
+
+        size_t lastChar = inputStr.find_last_not_of(" \t");
+        if (inputStr[lastChar] == '&') {
+            startJob(session, inputStr.substr(0, lastChar), out);
+            return;
+        }
+
+        TraceSpan commandSpan("command");
+        commandSpan.setDetail(inputStr);
+        commandSpan.count(inputStr.size(), 0);
+
+        vector<Stage> stages;
+        string target;
+        bool append = false;
+        {
+            TraceSpan parseSpan("parse");
+            bool parsed = parsePipeline(inputStr, stages, target, append, out);
+            parseSpan.count(inputStr.size(), stages.size());
+            if (!parsed)
+                return;
+        }
+
+        bool mutating = !target.empty();
+        for (auto& stage : stages) {
+            mutating = mutating || isMutating(stage.command);
+            prepare(stage);
+        }
+
+        if (stages.size() == 1 && target.empty()) {
+            // A single command runs on this thread with the session itself, so cd changes the session
+            Stage& stage = stages[0];
+            istringstream noInput;
+            if (mutating) {
+                {
+                    TraceSpan mutationSpan("tree mutation");
+                    unique_lock<shared_mutex> lock(treeMutex);
+                    try {
+                        dispatch(stage, session, noInput, out, out);
+                    } catch (const DiskQuotaExceeded& err) {
+                        // A change that does not fit is refused before it touches the tree
+                        out << err.what() << "\n";
+                    }
+                }
+
+                // The records are written by the writer thread of the disk, the size is known without waiting for it
+                checkDiskSizes();
+            } else if (stage.command == Commands::sync) {
+                // Waits until every change made so far is on the disk
+                sync();
+            } else if (stage.command == Commands::jobs || stage.command == Commands::wait
+                       || stage.command == Commands::kill) {
+                // Jobs wait for the tree, so waiting for them while holding it would never end
+                controlJobs(stage.command, stage.words, session, out);
+            } else {
+                shared_lock<shared_mutex> lock(treeMutex);
+                dispatch(stage, session, noInput, out, out);
+            }
+            return;
+        }
+
+        if (!mutating) {
+            shared_lock<shared_mutex> lock(treeMutex);
+            runConcurrently(stages, session, out, out);
+            return;
+        }
+
+        {
+            TraceSpan mutationSpan("tree mutation");
+            unique_lock<shared_mutex> lock(treeMutex);
+            try {
+                if (target.empty()) {
+                    runConcurrently(stages, session, out, out);
+                } else {
+                    // The file is created (or emptied) before the stages run, their output is collected in chunks
+                    // and added to it once they have ended. Messages of the stages are printed, not written to it.
+                    Directory* targetDir = &findDirectory(session);
+                    uint64_t number = targetDir->prepareWrite(target, append);
+
+                    ChunkWriteBuffer fileBuffer;
+                    std::ostream fileOut(&fileBuffer);
+                    runConcurrently(stages, session, fileOut, out);
+
+                    // An umount in the pipeline can take the directory away
+                    vector<string> chunks = fileBuffer.takeChunks();
+                    if (&findDirectory(session) == targetDir)
+                        targetDir->appendChunks(target, number, chunks);
+                }
+            } catch (const FileIsDirectory& err) {
+                out << err.what() << "\n";
+            } catch (const DiskQuotaExceeded& err) {
+                out << err.what() << "\n";
+            }
+        }
+
+        checkDiskSizes();
+    }
+
+    void Shell::runConcurrently(vector<Stage>& stages, const Session& session, std::ostream& out,
+                                std::ostream& errors) {
+        // Every stage gets a copy of the session, so a cd inside a pipeline does not change the session
+        vector<unique_ptr<Pipe>> pipes;
+        for (size_t i = 0; i + 1 < stages.size(); i++)
+            pipes.push_back(std::make_unique<Pipe>());
+
+        // Messages are kept apart from the output, so they are never read by the next stage
+        vector<ostringstream> messages(stages.size());
+
+        // When a stage changes the tree, the stages touch it in the order of the pipeline: a stage that changes the
+        // tree waits for every stage before it, the other stages wait for the stages before them that change it.
+        // Stages that read their input do not touch the tree, they never wait and keep the pipes moving.
+        bool ordered = std::any_of(stages.begin(), stages.end(), [](const Stage& stage) {
+            return isMutating(stage.command);
+        });
+        std::mutex orderMutex;
+        std::condition_variable stageEnded;
+        vector<bool> ended(stages.size(), false);
+        auto waitForTurn = [&](size_t i) {
+            if (!ordered || readsInput(stages[i]))
+                return;
+            bool changesTree = isMutating(stages[i].command);
+            std::unique_lock<std::mutex> lock(orderMutex);
+            stageEnded.wait(lock, [&] {
+                for (size_t j = 0; j < i; j++) {
+                    if (!ended[j] && (changesTree || isMutating(stages[j].command)))
+                        return false;
+                }
+                return true;
+            });
+        };
+
+        vector<std::exception_ptr> failures(stages.size());
+        const std::atomic<bool>* killFlag = JobControl::flag();
+        auto runStage = [&](size_t i) {
+            JobControl::setFlag(killFlag);
+            try {
+                Session stageSession = session;
+                std::unique_ptr<PipeReadBuffer> inBuffer;
+                if (i > 0) {
+                    inBuffer = std::make_unique<PipeReadBuffer>(*pipes[i - 1]);
+                    // A stage that ignores its input lets the previous one finish without waiting for a reader
+                    if (!readsInput(stages[i]))
+                        pipes[i - 1]->closeReader();
+                }
+                std::istream in(inBuffer.get());
+
+                if (i + 1 < stages.size()) {
+                    // Destroying the buffer flushes it and tells the next stage that the output has ended
+                    PipeWriteBuffer outBuffer(*pipes[i]);
+                    std::ostream stageOut(&outBuffer);
+                    waitForTurn(i);
+                    dispatch(stages[i], stageSession, in, stageOut, messages[i]);
+                } else {
+                    waitForTurn(i);
+                    dispatch(stages[i], stageSession, in, out, messages[i]);
+                }
+            } catch (...) {
+                failures[i] = std::current_exception();
+                // Let the neighbours of the failed stage finish
+                if (i > 0)
+                    pipes[i - 1]->closeReader();
+                if (i + 1 < stages.size())
+                    pipes[i]->closeWriter();
+            }
+
+            std::lock_guard<std::mutex> lock(orderMutex);
+            ended[i] = true;
+            stageEnded.notify_all();
+        };
+
+        // The last stage runs on this thread
+        vector<std::thread> threads;
+        for (size_t i = 0; i + 1 < stages.size(); i++)
+            threads.emplace_back(runStage, i);
+        runStage(stages.size() - 1);
+
+        for (auto& thread : threads)
+            thread.join();
+        for (const auto& stageMessages : messages)
+            errors << stageMessages.str();
+        for (const auto& failure : failures) {
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+    }
+
+    vector<File*> Shell::resolveArgument(const Directory& dir, const string& word, std::ostream& errors) {
+        if (!Directory::isGlob(word)) {
+            File* filePtr = dir.findFile(word);
+            return filePtr ? vector<File*>{ filePtr } : vector<File*>{};
+        }
+
+        auto matches = dir.glob(word);
+        if (matches.empty())
+            errors << "No match: " << word << "\n";
+        return matches;
+    }
+
+    void Shell::startJob(Session& session, const string& line, std::ostream& out) {
+        // A job runs on one thread, a line that ends with & inside it runs right away
+        if (JobControl::flag()) {
+            execute(session, line, out);
+            return;
+        }
+        if (line.find_first_not_of(" \t") == string::npos) {
+            out << "Syntax error near: &\n";
+            return;
+        }
+
+        // Errors in the line are printed now, not when the job ends
+        vector<Stage> stages;
+        string target;
+        bool append = false;
+        if (!parsePipeline(line, stages, target, append, out))
+            return;
+
+        std::call_once(jobPoolStarted, [this] {
+            jobPool = std::make_unique<JobPool>(std::max(2u, std::thread::hardware_concurrency()));
+        });
+        if (!session.jobs)
+            session.jobs = make_shared<JobList>();
+        string jobLine = line.substr(line.find_first_not_of(" \t"));
+        jobLine.erase(jobLine.find_last_not_of(" \t") + 1);
+        auto job = session.jobs->add(jobLine);
+
+        // The job works in a copy of the session, a cd inside it does not move the session
+        Session jobSession = session;
+        jobPool->submit(session.jobs, job, [this, jobSession, jobLine](std::ostream& jobOut) mutable {
+            execute(jobSession, jobLine, jobOut);
+        });
+        out << "[" << job->number << "] " << jobLine << "\n";
+    }
+
+    void Shell::controlJobs(Commands command, const vector<string>& words, Session& session, std::ostream& out) {
+        if (JobControl::flag()) {
+            out << "Job control is not available inside a job\n";
+            return;
+        }
+        if (command == Commands::jobs) {
+            if (session.jobs)
+                session.jobs->list(out);
+            return;
+        }
+
+        // Jobs are named %n, wait without one waits for every job
+        vector<uint64_t> numbers;
+        for (size_t i = 1; i < words.size(); i++) {
+            const string& word = words[i];
+            if (word.size() < 2 || word.size() > 19 || word[0] != '%'
+                || word.find_first_not_of("0123456789", 1) != string::npos) {
+                out << "Invalid job: " << word << "\n";
+                return;
+            }
+            numbers.push_back(std::stoull(word.substr(1)));
+        }
+        if (command == Commands::kill && numbers.empty())
+            return;
+        if (numbers.empty())
+            numbers.push_back(0);
+
+        for (uint64_t number : numbers) {
+            bool found = session.jobs && (command == Commands::kill ? session.jobs->kill(number)
+                                                                    : session.jobs->wait(number));
+            if (!found && number != 0)
+                out << "No such job: %" << number << "\n";
+        }
+        if (command == Commands::wait && session.jobs && session.jobs->report(out))
+            checkDiskSizes();
+    }
+
+    void Shell::prepare(Stage& stage) {
+        if (stage.command != Commands::import || stage.words.size() < 2)
+            return;
+        try {
+            stage.hostTree = make_shared<Directory::HostTree>(Directory::readHostTree(stage.words[1]));
+        } catch (const PathNotFound&) {
+            // Reported by the import itself
+        }
+    }
+
+    void Shell::mountImage(const vector<string>& words, Directory& currentDirectory, std::ostream& out,
+                           std::ostream& errors) {
+        if (words.size() < 2) {
+            // Without arguments the mount table is listed
+            for (const auto& mount : mounts) {
+                DiskImage& mountDisk = mount.second->getDisk();
+                out << std::left << std::setw(20) << mount.second->getImagePath() << std::setw(20)
+                    << mount.second->getRoot().getPath() << std::setw(12)
+                    << (mount.second->isLoaded() ? "loaded" : "not loaded") << std::fixed << std::setprecision(2)
+                    << mountDisk.physicalSize() / (1024.0 * 1024.0) << "/"
+                    << mountDisk.getQuota() / (1024.0 * 1024.0) << " MB\n";
+                out.unsetf(std::ios::floatfield);
+            }
+            return;
+        }
+        if (words.size() < 3)
+            return;
+        const string& imagePath = words[1];
+        const string& mountPath = words[2];
+
+        size_t quotaBytes = disk->getQuota();
+        if (words.size() >= 4) {
+            char* end = nullptr;
+            double megabytes = strtod(words[3].c_str(), &end);
+            if (*end != '\0' || !(megabytes > 0)) {
+                errors << "Invalid quota: " << words[3] << "\n";
+                return;
+            }
+            quotaBytes = static_cast<size_t>(llround(megabytes * 1024 * 1024));
+        }
+
+        // The mount point is a new directory in an existing one
+        size_t lastSlash = mountPath.find_last_of('/');
+        string name = mountPath.substr(lastSlash == string::npos ? 0 : lastSlash + 1);
+        Directory* host = &currentDirectory;
+        if (lastSlash != string::npos) {
+            string hostPath = mountPath.substr(0, lastSlash);
+            File* found = (mountPath[0] == '/') ? root.findPath(hostPath) : currentDirectory.findPath(hostPath);
+            if (!found || found->getType() != 'D') {
+                errors << "No such directory: " << (hostPath.empty() ? "/" : hostPath) << "\n";
+                return;
+            }
+            host = asDirectory(found);
+        }
+        if (name.empty() || name == "." || name == "..") {
+            errors << "Invalid file name: " << mountPath << "\n";
+            return;
+        }
+        if (host->findFile(name)) {
+            errors << DirectoryAlreadyExists(name).what() << "\n";
+            return;
+        }
+
+        // Two disks writing the same file would lose records
+        namespace fs = std::filesystem;
+        fs::path imageFile = fs::absolute(imagePath).lexically_normal();
+        bool inUse = imageFile == fs::absolute(disk->getPath()).lexically_normal();
+        for (const auto& mount : mounts)
+            inUse = inUse || imageFile == fs::absolute(mount.second->getImagePath()).lexically_normal();
+        if (inUse) {
+            errors << "Image is already in use: " << imagePath << "\n";
+            return;
+        }
+
+        try {
+            auto mount = std::make_unique<Mount>(imagePath, name, *disk);
+            mount->getDisk().setQuota(quotaBytes, disk->getQuotaMode());
+            host->addFile(&mount->getRoot());
+            mounts.emplace(nextMountId++, std::move(mount));
+            mountCount = mounts.size();
+        } catch (const ShellExceptions& err) {
+            // Not an image, a missing segment or an image that can not be created
+            errors << err.what() << "\n";
+        }
+    }
+
+    void Shell::unmountImage(const vector<string>& words, Directory& currentDirectory, std::ostream& errors) {
+        if (words.size() < 2)
+            return;
+        const string& mountPath = words[1];
+        File* found = (mountPath[0] == '/') ? root.findPath(mountPath) : currentDirectory.findPath(mountPath);
+        Directory* mountRoot = (found && found->getType() == 'D') ? asDirectory(found) : nullptr;
+        if (!mountRoot || !mountRoot->getMount()) {
+            errors << "Not a mount point: " << mountPath << "\n";
+            return;
+        }
+
+        auto mountIt = std::find_if(mounts.begin(), mounts.end(), [&](const auto& mount) {
+            return mount.second.get() == mountRoot->getMount();
+        });
+        // A mount inside this one would lose its mount point
+        for (const auto& mount : mounts) {
+            if (mount.first == mountIt->first)
+                continue;
+            for (const Directory* dir = mount.second->getRoot().getParent(); dir; dir = dir->getParent()) {
+                if (dir == mountRoot) {
+                    errors << MountPointBusy(mountRoot->getPath()).what() << "\n";
+                    return;
+                }
+            }
+        }
+
+        // The image keeps everything written to it, sessions inside it continue from the root
+        mountIt->second->getDisk().sync();
+        mountRoot->getParent()->detachMount(*mountRoot);
+        mounts.erase(mountIt);
+        mountCount = mounts.size();
+    }
+
+    void Shell::dispatch(const Stage& stage, Session& session, std::istream& in, std::ostream& out,
+                         std::ostream& errors) {
+        Commands command = stage.command;
+        const vector<string>& words = stage.words;
+        TraceSpan dispatchSpan("dispatch");
+        if (dispatchSpan.active()) {
+            dispatchSpan.setDetail(words[0]);
+            for (const auto& word : words)
+                dispatchSpan.count(word.size(), 1);
+        }
+
+        // Stages that read their input never use the working directory, they do not touch the tree at all (see
+        // runConcurrently)
+        Directory& currentDirectory = readsInput(stage) ? root : findDirectory(session);
+        const string& currentPath = session.currentPath;
+
+        // Execute the commands
+        switch (command) {
+            case (Commands::ls): {
+                // ls [-R] [--json | -0] [-S | -t | --sort added|name|size|time] [--limit n] [--offset n] [--after name]
+                bool recursive = false;
+                bool paged = false;
+                Directory::ListOptions options;
+                auto isCount = [](const string& word) {
+                    return !word.empty() && word.size() < 19 && word.find_first_not_of("0123456789") == string::npos;
+                };
+
+                for (size_t i = 1; i < words.size(); i++) {
+                    const string& option = words[i];
+                    bool hasValue = i + 1 < words.size();
+                    if (option == "-R") {
+                        recursive = true;
+                    } else if (option == "--json") {
+                        options.format = Directory::ListFormat::json;
+                    } else if (option == "-0") {
+                        options.format = Directory::ListFormat::nul;
+                    } else if (option == "-S") {
+                        options.order = Directory::ListOrder::size;
+                    } else if (option == "-t") {
+                        options.order = Directory::ListOrder::time;
+                    } else if (option == "--sort" && hasValue) {
+                        const string& key = words[++i];
+                        if (key == "added") {
+                            options.order = Directory::ListOrder::added;
+                        } else if (key == "name") {
+                            options.order = Directory::ListOrder::name;
+                        } else if (key == "size") {
+                            options.order = Directory::ListOrder::size;
+                        } else if (key == "time") {
+                            options.order = Directory::ListOrder::time;
+                        } else {
+                            errors << "Unknown sort key: " << key << "\n";
+                            return;
+                        }
+                    } else if ((option == "--limit" || option == "--offset") && hasValue) {
+                        const string& count = words[++i];
+                        if (!isCount(count)) {
+                            errors << "Invalid count: " << count << "\n";
+                            return;
+                        }
+                        (option == "--limit" ? options.limit : options.offset) = std::stoull(count);
+                    } else if (option == "--after" && hasValue) {
+                        options.after = words[++i];
+                    } else {
+                        errors << "Unknown option: " << option << "\n";
+                        return;
+                    }
+                    paged = paged || (option != "-R" && option != "--json" && option != "-0");
+                }
+
+                if (recursive && paged) {
+                    errors << "Sorting and paging only apply to ls without -R\n";
+                } else if (recursive) {
+                    currentDirectory.lsRecursive(out, options.format);
+                } else {
+                    currentDirectory.ls(out, options, errors);
+                }
+                break;
+            }
+            case (Commands::mkdir): {
+                try {
+                    if(words.size() < 2)
+                        return;
+
+                    string dirName = words[1];
+                    currentDirectory.mkdir(dirName);
+
+                } catch (DirectoryAlreadyExists& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+            case (Commands::rm): {
+                if(words.size() < 2)
+                    return;
+
+                // Every argument can be a name or a glob, all matching files are removed with one disk rewrite
+                vector<File*> entries;
+                for (size_t i = 1; i < words.size(); i++) {
+                    string pathValue;
+                    if(currentPath.back() == '/') pathValue = currentPath + words[i];
+                    else pathValue = currentPath + "/" + words[i];
+
+                    auto matches = resolveArgument(currentDirectory, words[i], errors);
+                    if (matches.empty() && !Directory::isGlob(words[i]))
+                        errors << PathNotFound(pathValue).what() << "\n";
+
+                    for (const auto& filePtr : matches) {
+                        if (filePtr->getType() == 'D')
+                            errors << FileIsDirectory(filePtr->getPath()).what() << "\n";
+                        else
+                            entries.push_back(filePtr);
+                    }
+                }
+                if (entries.empty())
+                    return;
+
+                try {
+                    currentDirectory.rm(entries);
+                } catch(PathNotFound& err) {
+                    errors << err.what() << "\n";
+                } catch(ContentsFileNotFound& err) {
+                    errors << err.what() << "\n";
+                } catch(FileIsDirectory& err) {
+                    errors << err.what() << "\n";
+                }
+
+                break;
+            }
+            case (Commands::rmdir): {
+                if(words.size() < 2)
+                    return;
+
+                vector<File*> entries;
+                for (size_t i = 1; i < words.size(); i++) {
+                    string pathValue;
+                    if(currentPath.back() == '/') pathValue = currentPath + words[i];
+                    else pathValue = currentPath + "/" + words[i];
+
+                    auto matches = resolveArgument(currentDirectory, words[i], errors);
+                    if (matches.empty() && !Directory::isGlob(words[i]))
+                        errors << PathNotFound(pathValue).what() << "\n";
+
+                    for (const auto& filePtr : matches) {
+                        // The "." entry of a root is never removed
+                        if (filePtr->getInode() == currentDirectory.getInode())
+                            continue;
+                        if (filePtr->getType() != 'D')
+                            errors << NotDirectory(filePtr->getPath()).what() << "\n";
+                        else
+                            entries.push_back(filePtr);
+                    }
+                }
+                if (entries.empty())
+                    return;
+
+                try {
+                    currentDirectory.rmdir(entries);
+                } catch(PathNotFound& err) {
+                    errors << err.what() << "\n";
+                } catch(ContentsFileNotFound& err) {
+                    errors << err.what() << "\n";
+                } catch(NotDirectory& err) {
+                    errors << err.what() << "\n";
+                } catch(MountPointBusy& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+            case (Commands::cp): {
+                if(words.size() < 2)
+                    return;
+
+                for (size_t i = 1; i < words.size(); i++) {
+                    // Globs are expanded against the current directory, host paths are copied as they are
+                    vector<string> sourcePaths;
+                    if (Directory::isGlob(words[i]) && words[i].find('/') == string::npos) {
+                        for (const auto& filePtr : resolveArgument(currentDirectory, words[i], errors))
+                            sourcePaths.push_back(filePtr->getName());
+                    } else {
+                        sourcePaths.push_back(words[i]);
+                    }
+
+                    for (const auto& sourcePath : sourcePaths) {
+                        try {
+                            currentDirectory.cp(sourcePath);
+                        } catch (PathNotFound& err) {
+                            errors << err.what() << "\n";
+                        } catch(FileIsDirectory& err) {
+                            errors << err.what() << "\n";
+                        }
+                    }
+                }
+                break;
+            }
+            case (Commands::link): {
+                if(words.size() < 3)
+                    return;
+                string sourceFile = words[1];
+                string targetName = words[2];
+                currentDirectory.link(errors, sourceFile, targetName);
+                break;
+            }
+            case (Commands::ln): {
+                // ln <file> <name>, the new entry refers to the same inode as the file
+                if(words.size() < 3)
+                    return;
+                const string& sourcePath = words[1];
+                const string& name = words[2];
+                File* source = (sourcePath[0] == '/') ? root.findPath(sourcePath) : currentDirectory.findFile(sourcePath);
+                if (!source) {
+                    errors << "No such file or directory: " << sourcePath << "\n";
+                    return;
+                }
+                if (name.find('/') != string::npos || name == "." || name == "..") {
+                    errors << "Invalid file name: " << name << "\n";
+                    return;
+                }
+
+                try {
+                    currentDirectory.hardLink(*source, name);
+                } catch (FileIsDirectory& err) {
+                    errors << err.what() << "\n";
+                } catch (DirectoryAlreadyExists& err) {
+                    errors << err.what() << "\n";
+                } catch (CrossMountOperation& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+            case (Commands::mv): {
+                // mv <name> <destination>, an existing directory is moved into, anything else is the new path
+                if(words.size() < 3)
+                    return;
+                const string& sourceName = words[1];
+                const string& destination = words[2];
+                File* source = currentDirectory.findFile(sourceName);
+                if (!source || source->getInode() == currentDirectory.getInode()) {
+                    errors << "No such file or directory: " << sourceName << "\n";
+                    return;
+                }
+
+                Directory* targetDir = nullptr;
+                string newName = source->getName();
+                File* found = (destination[0] == '/') ? root.findPath(destination) : currentDirectory.findPath(destination);
+                if (destination == "..") {
+                    targetDir = currentDirectory.getParent() ? currentDirectory.getParent() : &root;
+                } else if (found && found->getType() == 'D') {
+                    targetDir = asDirectory(found);
+                } else {
+                    size_t lastSlash = destination.find_last_of('/');
+                    newName = destination.substr(lastSlash == string::npos ? 0 : lastSlash + 1);
+                    if (lastSlash == string::npos) {
+                        targetDir = &currentDirectory;
+                    } else {
+                        string dirPath = destination.substr(0, lastSlash);
+                        File* dir = (destination[0] == '/') ? root.findPath(dirPath) : currentDirectory.findPath(dirPath);
+                        if (!dir || dir->getType() != 'D') {
+                            errors << "No such directory: " << (dirPath.empty() ? "/" : dirPath) << "\n";
+                            return;
+                        }
+                        targetDir = asDirectory(dir);
+                    }
+                    if (newName.empty() || newName == "." || newName == "..") {
+                        errors << "Invalid file name: " << destination << "\n";
+                        return;
+                    }
+                }
+
+                try {
+                    currentDirectory.move(source, *targetDir, newName);
+                    moves++;
+                } catch (DirectoryAlreadyExists& err) {
+                    errors << err.what() << "\n";
+                } catch (InvalidMove& err) {
+                    errors << err.what() << "\n";
+                } catch (MountPointBusy& err) {
+                    errors << err.what() << "\n";
+                } catch (CrossMountOperation& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+            case (Commands::write):
+            case (Commands::append): {
+                // write <file> <text> replaces the content, append <file> <text> adds a line to the end of it
+                if(words.size() < 2)
+                    return;
+                const string& name = words[1];
+                if (name.find('/') != string::npos || name == "." || name == "..") {
+                    errors << "Invalid file name: " << name << "\n";
+                    return;
+                }
+
+                string text;
+                for (size_t i = 2; i < words.size(); i++)
+                    text += (i > 2 ? " " : "") + words[i];
+
+                try {
+                    currentDirectory.writeFile(name, text, command == Commands::append);
+                } catch (const FileIsDirectory& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+            case (Commands::stat): {
+                for (size_t i = 1; i < words.size(); i++) {
+                    auto matches = resolveArgument(currentDirectory, words[i], errors);
+                    if (matches.empty() && !Directory::isGlob(words[i]))
+                        errors << "No such file or directory: " << words[i] << "\n";
+
+                    for (const auto& filePtr : matches) {
+                        const Inode& fileInode = *filePtr->getInode();
+                        out << std::left << std::setw(4) << fileInode.type << std::setw(20) << filePtr->getName()
+                            << "inode " << fileInode.number << "  links " << fileInode.linkCount << "  size "
+                            << fileInode.size << "  " << Timestamp::format(fileInode.time) << "\n";
+                    }
+                }
+                break;
+            }
+            case (Commands::cd): {
+                if(words.size() < 2)
+                    return;
+                string newDir = words[1];
+                Directory* target = Directory::cd(currentDirectory, newDir, errors);
+                if (target) {
+                    session.currentPath = target->getPath();
+                    session.directory = target->getHandle();
+                    session.mount = mountIdOf(*target);
+                    session.moves = moves;
+                }
+                break;
+            }
+            case (Commands::cat): {
+                if(words.size() < 2) {
+                    // Copy the input in chunks, so that large outputs are never held in memory at once
+                    char chunk[4096];
+                    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+                        JobControl::checkKilled();
+                        if (!out.write(chunk, in.gcount()))
+                            break;
+                    }
+                    return;
+                }
+                for (size_t i = 1; i < words.size(); i++) {
+                    const string& filename = words[i];
+                    if (filename == ".") {
+                        // The working directory itself, also outside of the root where there is no "." entry
+                        currentDirectory.cat(out);
+                        continue;
+                    }
+
+                    auto matches = resolveArgument(currentDirectory, filename, errors);
+                    if (matches.empty() && !Directory::isGlob(filename))
+                        errors << "No such file or directory: " << filename << "\n";
+
+                    for (const auto& filePtr : matches) {
+                        try {
+                            filePtr->cat(out);
+                        } catch(const FileNotFound& err) {
+                            errors << err.what() << "\n";
+                        } catch(const FileIsDirectory& err) {
+                            errors << err.what() << "\n";
+                        }
+                    }
+                }
+                break;
+            }
+            case (Commands::sync):
+                syncDisks();
+                break;
+            case (Commands::mount):
+                mountImage(words, currentDirectory, out, errors);
+                break;
+            case (Commands::umount):
+                unmountImage(words, currentDirectory, errors);
+                break;
+            case (Commands::jobs):
+            case (Commands::kill):
+                controlJobs(command, words, session, out);
+                break;
+            case (Commands::wait):
+                errors << "wait can not be used in a pipeline or a redirection\n";
+                break;
+            case (Commands::exportTree): {
+                // export [-L] <vfspath> <hostdir>, -L copies every soft link instead of making symlinks
+                vector<string> arguments;
+                bool copyLinks = false;
+                for (size_t i = 1; i < words.size(); i++) {
+                    if (words[i] == "-L")
+                        copyLinks = true;
+                    else
+                        arguments.push_back(words[i]);
+                }
+                if (arguments.size() < 2)
+                    return;
+                const string& vfsPath = arguments[0];
+                const string& hostDir = arguments[1];
+
+                // "." and "/" are written as the host directory itself, anything else goes inside it
+                const File* node;
+                string hostPath = hostDir;
+                if (vfsPath == ".") {
+                    node = &currentDirectory;
+                } else {
+                    node = (vfsPath[0] == '/') ? root.findPath(vfsPath) : currentDirectory.findFile(vfsPath);
+                    if (node && node != &root)
+                        hostPath = hostDir + "/" + node->getName();
+                }
+                if (!node) {
+                    errors << "No such file or directory: " << vfsPath << "\n";
+                    return;
+                }
+
+                Directory::exportTree(errors, *node, hostPath, copyLinks);
+                break;
+            }
+            case (Commands::import): {
+                if(words.size() < 2)
+                    return;
+                const string& hostDir = words[1];
+
+                // Without a name the new directory is named after the host directory
+                string targetName = words.size() >= 3 ? words[2] : "";
+                if (targetName.empty()) {
+                    std::filesystem::path hostPath = std::filesystem::path(hostDir).lexically_normal();
+                    targetName = hostPath.filename().string();
+                    if (targetName.empty())
+                        targetName = hostPath.parent_path().filename().string();
+                }
+                if (targetName.empty() || targetName.find('/') != string::npos || targetName == "." || targetName == "..") {
+                    errors << "Invalid file name: " << targetName << "\n";
+                    return;
+                }
+
+                try {
+                    if (stage.hostTree)
+                        currentDirectory.addHostTree(errors, *stage.hostTree, targetName);
+                    else
+                        currentDirectory.importTree(errors, hostDir, targetName);
+                } catch (PathNotFound& err) {
+                    errors << err.what() << "\n";
+                } catch (DirectoryAlreadyExists& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+            case (Commands::grep): {
+                if(words.size() < 2)
+                    return;
+                const string& pattern = words[1];
+
+                if(words.size() < 3) {
+                    // Filter the input line by line
+                    string line;
+                    while (getline(in, line) && out) {
+                        JobControl::checkKilled();
+                        if (line.find(pattern) != string::npos)
+                            out << line << "\n";
+                    }
+                    return;
+                }
+
+                const string& filename = words[2];
+                const File* file = nullptr;
+                for (const auto& filePtr : currentDirectory.getFiles()) {
+                    if (filePtr->getName() == filename) {
+                        file = filePtr;
+                        break;
+                    }
+                }
+                if(!file) {
+                    errors << "No such file or directory: " << filename << "\n";
+                    return;
+                }
+                if(file->getType() == 'D') {
+                    errors << FileIsDirectory(filename).what() << "\n";
+                    return;
+                }
+
+                try {
+                    // Walk the content with the file iterators, only the current line is copied
+                    string line;
+                    auto endIt = file->end();
+                    for (auto it = file->begin(); it != endIt; ++it) {
+                        if (*it != '\n') {
+                            line += *it;
+                            continue;
+                        }
+                        JobControl::checkKilled();
+                        if (line.find(pattern) != string::npos)
+                            out << line << "\n";
+                        line.clear();
+                    }
+                    if (!line.empty() && line.find(pattern) != string::npos)
+                        out << line << "\n";
+                } catch(const FileNotFound& err) {
+                    errors << err.what() << "\n";
+                }
+                break;
+            }
+        }
+    }
+} //GTUShell namespace
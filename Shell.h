@@ -0,0 +1,149 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "File.h"
+#include "Directory.h"
+#include "Jobs.h"
+#include "Mount.h"
+
+namespace GTUShell {
+    enum class Commands {
+        ls, mkdir, rm, cp, link, cd, cat, rmdir, sync, grep, import, exportTree, ln, mv, stat, write, append, mount, umount, jobs, wait, kill
+    };
+
+    // Holds the state that belongs to a single user of the shell
+    struct Session {
+        string currentPath = "/";
+        // Handle of the working directory in the arena of the tree, empty for the root
+        NodeHandle directory;
+        // Mount whose arena the handle belongs to, 0 for the tree of disk.txt
+        uint64_t mount = 0;
+        // Number of moves in the tree when currentPath was last built
+        uint64_t moves = 0;
+        // Jobs started with &, created with the first one
+        shared_ptr<JobList> jobs;
+        // Tells the sessions apart in a recorded log
+        uint64_t id = 0;
+    };
+
+    // Owns the in-memory file tree and executes command lines against it.
+    // Reading commands run in parallel, commands that modify the tree are serialized.
+    class Shell {
+    public:
+        explicit Shell(const string& diskPath = "disk.txt");
+
+        // Waits for the writer of the disk, so that nothing is lost when the shell is closed
+        ~Shell();
+
+        // Getter for the disk that stores the tree
+        DiskImage& getDisk();
+
+        // Waits until every change made so far is on disk.txt and on the mounted images
+        void sync();
+
+        // Reads the contents of the disk into the tree, damaged records that are skipped are reported to messages
+        void load(std::ostream& messages);
+
+        // Parses one command line and executes it for the given session, output is written to out.
+        // Commands can be chained with | and the output of the last one can be sent to a file with > or >>.
+        // A line that ends with & runs as a job of the session, jobs that finished are reported before the next line.
+        void execute(Session& session, const string& inputStr, std::ostream& out);
+
+        // Returns the prompt that is shown before reading a command
+        static string prompt(const Session& session);
+
+    private:
+        // One command of a pipeline
+        struct Stage {
+            Commands command;
+            vector<string> words;
+            // The host directory of an import, read before the tree is locked
+            shared_ptr<Directory::HostTree> hostTree;
+        };
+
+        // Declared before the root, the nodes of the tree are destroyed after it
+        NodeArena arena;
+        Directory root;
+        shared_ptr<DiskImage> disk;
+        std::shared_mutex treeMutex;
+
+        // Mounted images by their id, declared after the root so they are unmounted before it is destroyed
+        std::map<uint64_t, std::unique_ptr<Mount>> mounts;
+        uint64_t nextMountId = 1;
+        // Size of mounts, read without the tree so lines skip the messages of the mounts when there are none
+        std::atomic<size_t> mountCount{0};
+
+        // Counts the mv commands, a working directory may have a new path after one
+        std::atomic<uint64_t> moves{0};
+        std::unordered_map<string, Commands> commandMap;
+
+        // Runs the jobs, started with the first job and declared last so that jobs end before the tree is destroyed
+        std::once_flag jobPoolStarted;
+        std::unique_ptr<JobPool> jobPool;
+
+        static bool isMutating(Commands command);
+
+        // Runs the line of execute after the jobs are reported
+        void runLine(Session& session, const string& inputStr, std::ostream& out);
+
+        // Writes the messages of the mounted images that were read during the line
+        void reportMountMessages(std::ostream& out);
+
+        // Checks the line and queues it as a job of the session
+        void startJob(Session& session, const string& line, std::ostream& out);
+
+        // jobs, wait [%n...] and kill %n...
+        void controlJobs(Commands command, const vector<string>& words, Session& session, std::ostream& out);
+
+        // Reads the host directories of imports, so the tree is only locked while the files are added
+        static void prepare(Stage& stage);
+
+        // Syncs every disk, the caller holds the tree
+        void syncDisks();
+
+        // Throws DiskExceedsLimit if disk.txt or a loaded image is larger than its quota
+        void checkDiskSizes();
+
+        // Id of the mount whose arena holds the directory, 0 for the tree of disk.txt
+        uint64_t mountIdOf(const Directory& dir) const;
+
+        // The directory a path resolved to, the "." entry of a root stands for the root itself
+        static Directory* asDirectory(File* found);
+
+        // mount [<image> <path> [quota MB]] and umount <path>
+        void mountImage(const vector<string>& words, Directory& currentDirectory, std::ostream& out,
+                        std::ostream& errors);
+        void unmountImage(const vector<string>& words, Directory& currentDirectory, std::ostream& errors);
+
+        // True if the command reads the output of the previous command
+        static bool readsInput(const Stage& stage);
+
+        // Splits the line into stages and the target of the redirection, prints the error and returns false if
+        // the line is not valid
+        bool parsePipeline(const string& inputStr, vector<Stage>& stages, string& target, bool& append,
+                           std::ostream& out) const;
+
+        // Runs the stages at the same time, each one reading the output of the previous one through a pipe. The
+        // messages of the stages are written to errors in the order of the stages once they have ended.
+        void runConcurrently(vector<Stage>& stages, const Session& session, std::ostream& out, std::ostream& errors);
+
+        // Finds the working directory of the session, falls back to root if it does not exist anymore.
+        // The path of the session is built again if anything was moved since it was set.
+        Directory& findDirectory(Session& session);
+
+        // Returns the children of the directory a command argument refers to: the child with the name, or every
+        // child that matches the glob pattern. Patterns without a match are reported.
+        static vector<File*> resolveArgument(const Directory& dir, const string& word, std::ostream& errors);
+
+        // Runs one command, its output goes to out and its error messages to errors
+        void dispatch(const Stage& stage, Session& session, std::istream& in, std::ostream& out, std::ostream& errors);
+    };
+} //GTUShell namespace
+
+#endif //SHELL_H
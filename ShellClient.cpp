@@ -0,0 +1,73 @@
+#include "ShellClient.h"
+#include "ShellExceptions.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace GTUShell {
+
+    bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+            if (written <= 0)
+                return false;
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    ShellClient::ShellClient(const string& socketPath) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+            throw SocketError("socket path is too long: " + socketPath);
+        std::strcpy(address.sun_path, socketPath.c_str());
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw SocketError("socket: " + string(std::strerror(errno)));
+
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            string reason = std::strerror(errno);
+            close(fd);
+            throw SocketError("cannot connect to " + socketPath + ": " + reason);
+        }
+    }
+
+    ShellClient::~ShellClient() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool ShellClient::readReply(string& reply) {
+        char chunk[4096];
+        while (true) {
+            // Return the reply as soon as the terminator is in the buffer
+            size_t terminator = buffer.find(replyTerminator);
+            if (terminator != string::npos) {
+                reply.assign(buffer, 0, terminator);
+                buffer.erase(0, terminator + 1);
+                return true;
+            }
+
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+                return false;
+            buffer.append(chunk, received);
+        }
+    }
+
+    string ShellClient::request(const string& line) {
+        string message = line + "\n";
+        if (!writeAll(fd, message.data(), message.size()))
+            throw SocketError("connection to the daemon was lost");
+
+        string reply;
+        if (!readReply(reply))
+            throw SocketError("connection to the daemon was lost");
+        return reply;
+    }
+} //GTUShell namespace
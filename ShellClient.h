@@ -0,0 +1,38 @@
+#ifndef SHELLCLIENT_H
+#define SHELLCLIENT_H
+
+#include <string>
+
+using std::string;
+
+namespace GTUShell {
+    // Every reply of the daemon ends with the prompt followed by this byte
+    const char replyTerminator = '\0';
+
+    // Socket path that is used when none is given on the command line
+    const char* const defaultSocketPath = "myshell.sock";
+
+    // Connects to a running daemon and exchanges command lines with it
+    class ShellClient {
+    public:
+        explicit ShellClient(const string& socketPath);
+        ShellClient(const ShellClient&) = delete;
+        ShellClient& operator=(const ShellClient&) = delete;
+        ~ShellClient();
+
+        // Sends one command line and returns the reply (output and the next prompt)
+        string request(const string& line);
+
+        // Reads bytes until the reply terminator, returns false if the daemon closed the connection
+        bool readReply(string& reply);
+
+    private:
+        int fd = -1;
+        string buffer;
+    };
+
+    // Writes all of the given bytes to a socket, returns false if the peer is gone
+    bool writeAll(int fd, const char* data, size_t size);
+} //GTUShell namespace
+
+#endif //SHELLCLIENT_H
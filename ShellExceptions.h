@@ -1,3 +1,6 @@
+#ifndef SHELLEXCEPTIONS_H
+#define SHELLEXCEPTIONS_H
+
 #include <stdexcept>
 #include <string>
 
@@ -26,7 +29,7 @@ class ContentsFileNotFound : public ShellExceptions {
 
 class FileTypeInvalid : public ShellExceptions {
     public:
-    FileTypeInvalid() : ShellExceptions("Program terminated: invalid file type detected on 'disk.txt' file.\nYou may delete disk.txt and start the program again.\n") { }
+    explicit FileTypeInvalid(const std::string& filename) : ShellExceptions("Invalid file type detected on '" + filename + "' file") { }
 };
 
 class DirectoryAlreadyExists : public ShellExceptions {
@@ -44,14 +47,76 @@ public:
     explicit NotDirectory(const std::string& filename) : ShellExceptions("Not a directory: " + filename) { }
 };
 
+class InvalidMove : public ShellExceptions {
+public:
+    explicit InvalidMove(const std::string& filename) : ShellExceptions("Cannot move a directory into itself: " + filename) { }
+};
+
 class DirectoryNotEmpty : public ShellExceptions {
 public:
     explicit DirectoryNotEmpty(const std::string& filename) : ShellExceptions("Directory is not empty: " + filename) { }
 };
 
+class MountPointBusy : public ShellExceptions {
+public:
+    explicit MountPointBusy(const std::string& path) : ShellExceptions("Mount point is busy: " + path) { }
+};
+
+class CrossMountOperation : public ShellExceptions {
+public:
+    explicit CrossMountOperation(const std::string& filename) : ShellExceptions("Cannot link or move across mounted images: " + filename) { }
+};
+
 
 
 class DiskExceedsLimit : public ShellExceptions {
 public:
-    explicit DiskExceedsLimit() : ShellExceptions("Disk file exceed the limit of 10MB, terminating the system...\n\n") { }
-};
\ No newline at end of file
+    explicit DiskExceedsLimit(const std::string& limit) : ShellExceptions("Disk file exceed the limit of " + limit) { }
+};
+
+class DiskQuotaExceeded : public ShellExceptions {
+public:
+    explicit DiskQuotaExceeded(const std::string& limit) : ShellExceptions("Disk file would exceed the limit of " + limit + ", the change was not made") { }
+};
+
+class DiskWriteFailed : public ShellExceptions {
+public:
+    DiskWriteFailed(const std::string& filename, const std::string& reason) : ShellExceptions("Cannot write " + filename + ": " + reason) { }
+};
+
+class ContentCorrupted : public ShellExceptions {
+public:
+    ContentCorrupted() : ShellExceptions("Compressed content on the disk is corrupted") { }
+};
+
+class SegmentNotFound : public ShellExceptions {
+public:
+    explicit SegmentNotFound(const std::string& filename) : ShellExceptions("Segment '" + filename + "' of the disk was not found") { }
+};
+
+class RecordDamaged : public ShellExceptions {
+public:
+    RecordDamaged(const std::string& filename, size_t offset) : ShellExceptions("Damaged record at offset " + std::to_string(offset) + " of '" + filename + "', the older records after it can not be checked") { }
+};
+
+class ImageUnreadable : public ShellExceptions {
+public:
+    ImageUnreadable(const std::string& imagePath, const std::string& reason) : ShellExceptions("Cannot read the image " + imagePath + ", it stays unloaded: " + reason) { }
+};
+
+class SocketError : public ShellExceptions {
+public:
+    explicit SocketError(const std::string& what) : ShellExceptions("Socket error: " + what) { }
+};
+
+class JobKilled : public ShellExceptions {
+public:
+    JobKilled() : ShellExceptions("Job was killed") { }
+};
+
+class IteratorInvalidated : public ShellExceptions {
+public:
+    IteratorInvalidated() : ShellExceptions("Directory was modified while it was being read") { }
+};
+
+#endif //SHELLEXCEPTIONS_H
@@ -0,0 +1,89 @@
+#include "ShellServer.h"
+#include "Trace.h"
+
+#include <cstring>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace GTUShell {
+
+    void ShellServer::run() {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+            throw SocketError("socket path is too long: " + socketPath);
+        strcpy(address.sun_path, socketPath.c_str());
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0)
+            throw SocketError("socket: " + string(strerror(errno)));
+
+        // Remove the socket file left behind by a previous daemon
+        unlink(socketPath.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+            string reason = strerror(errno);
+            close(listenFd);
+            throw SocketError("cannot listen on " + socketPath + ": " + reason);
+        }
+
+        cout << "Serving the disk on " << socketPath << "\n";
+
+        while (true) {
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw SocketError("accept: " + string(strerror(errno)));
+            }
+
+            thread(&ShellServer::serveClient, this, clientFd).detach();
+        }
+    }
+
+    void ShellServer::serveClient(int clientFd) {
+        Trace::nameThread("client " + to_string(clientFd));
+        Session session;
+        session.id = nextSessionId++;
+        string pending;
+        char chunk[4096];
+
+        // Every reply is the output of the command followed by the next prompt and the terminator
+        string reply = Shell::prompt(session) + replyTerminator;
+        bool connected = writeAll(clientFd, reply.data(), reply.size());
+
+        while (connected) {
+            ssize_t received = recv(clientFd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+                break;
+            pending.append(chunk, received);
+
+            // Execute every complete line that has been received
+            size_t newline;
+            while (connected && (newline = pending.find('\n')) != string::npos) {
+                string line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+
+                ostringstream out;
+                try {
+                    shell.execute(session, line, out);
+                } catch (const ShellExceptions& err) {
+                    // Errors that would end an interactive shell only end this command. A disk over its quota is
+                    // reported to this client alone: changes that do not fit are refused before they are made
+                    // (see DiskImage::reserve), so only the records of small changes can take it over.
+                    out << err.what() << "\n";
+                }
+
+                reply = out.str() + Shell::prompt(session) + replyTerminator;
+                connected = writeAll(clientFd, reply.data(), reply.size());
+            }
+        }
+
+        close(clientFd);
+    }
+} //GTUShell namespace
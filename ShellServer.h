@@ -0,0 +1,27 @@
+#ifndef SHELLSERVER_H
+#define SHELLSERVER_H
+
+#include "Shell.h"
+#include "ShellClient.h"
+
+namespace GTUShell {
+    // Serves the shared tree of a Shell to many clients over a Unix domain socket.
+    // Every connection gets its own Session and thread, the Shell does the locking.
+    class ShellServer {
+    public:
+        ShellServer(Shell& shellVal, string socketPathVal) : shell(shellVal), socketPath(std::move(socketPathVal)) { }
+
+        // Accepts connections until the process is terminated
+        void run();
+
+    private:
+        Shell& shell;
+        string socketPath;
+        // Sessions of clients are numbered from 1, the session of the terminal is 0
+        std::atomic<uint64_t> nextSessionId{1};
+
+        void serveClient(int clientFd);
+    };
+} //GTUShell namespace
+
+#endif //SHELLSERVER_H
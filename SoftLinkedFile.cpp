@@ -1,40 +1,57 @@
 #include "SoftLinkedFile.h"
+#include "Inode.h"
 
 namespace GTUShell {
     File::iterator SoftLinkedFile::begin() const {
-        string targetFilePath = getContent();
-
-        // Find the file recursively and return the start of it
-        auto filePtr = findFile(targetFilePath, *rootCopy);
-        if(filePtr != nullptr) {
-            return filePtr->begin();
-        }
+        // Return the start of the content of the target
+        const Inode* targetInode = target();
+        if (targetInode != nullptr)
+            return targetInode->begin();
         return GTUShell::File::iterator();
     }
 
     File::iterator SoftLinkedFile::end() const {
-        string targetFilePath = getContent();
-
-        // Find the file recursively and return the start of it
-        auto filePtr = findFile(targetFilePath, *rootCopy);
-        if(filePtr != nullptr) return filePtr->end();
+        const Inode* targetInode = target();
+        if (targetInode != nullptr)
+            return targetInode->end();
         return GTUShell::File::iterator();
     }
 
-    shared_ptr<File> SoftLinkedFile::findFile(const string& pathToFind, const GTUShell::Directory &dir) const {
-        char type;
-        string path;
-        for(const auto& filePtr : dir.getFiles()) {
-            type = filePtr->getType();
-            path = filePtr->getPath();
-            if(pathToFind == path) {
-                return filePtr;
-            } else if(type == 'D' && path != "/") {
-                auto subDir = std::dynamic_pointer_cast<Directory>(filePtr);
-                if (subDir)
-                    return findFile(pathToFind, *subDir); // Recursively search in the subdirectory
+    const Inode* SoftLinkedFile::target() const {
+        const Directory& rootDir = root();
+        NodeArena* arena = rootDir.getArena();
+        // The generation is taken before the walk, a change made during it is seen by the next call
+        uint64_t generation = arena->entryGeneration();
+        if (cachedGeneration.load(std::memory_order_acquire) == generation) {
+            uint64_t number = cachedTarget.load(std::memory_order_relaxed);
+            if (number != 0) {
+                if (const Inode* cached = arena->inodes().get(number))
+                    return cached;
             }
         }
-        return nullptr;
+
+        // Links to links are followed, up to a limit so that a loop of links ends. Inode numbers and generations
+        // are only known in the image of the root, a path through a mounted image is walked each time.
+        bool sameImage = true;
+        const File* file = rootDir.findPath(getContent());
+        for (int depth = 0; file && file->getType() == 'S' && depth < 8; depth++) {
+            sameImage = sameImage && file->getParent()->getArena() == arena;
+            file = rootDir.findPath(file->getContent());
+        }
+        if (!file || file->getType() != 'F')
+            return nullptr;
+
+        if (sameImage && file->getParent()->getArena() == arena) {
+            cachedTarget.store(file->getInode()->number, std::memory_order_relaxed);
+            cachedGeneration.store(generation, std::memory_order_release);
+        }
+        return file->getInode();
+    }
+
+    const Directory& SoftLinkedFile::root() const {
+        const Directory* dir = getParent();
+        while (dir->getParent())
+            dir = dir->getParent();
+        return *dir;
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,7 @@
 #ifndef SOFTLINKEDFILE_H
 #define SOFTLINKEDFILE_H
+#include <atomic>
+
 #include "File.h"
 #include "Directory.h"
 
@@ -7,17 +9,26 @@ namespace GTUShell {
     class SoftLinkedFile : public File {
     public:
         SoftLinkedFile() = default;
-        SoftLinkedFile(const FileData& dataVal, const shared_ptr<Directory>& dir) : File(dataVal), rootCopy(dir) { }
 
         iterator begin() const override;
         iterator end() const override;
-        shared_ptr<File> findFile(const string& path, const GTUShell::Directory &dir) const;
 
+        // Returns the inode of the regular file the link points to, nullptr if there is none. A link refers to its
+        // path, like a soft link of POSIX: it is resolved against the tree as it is now, so a moved or removed target
+        // leaves the link dangling and a new file at the path becomes its target, in this process and after a
+        // restart alike. The inode number found is cached until an entry of the image is added, removed or renamed.
+        const Inode* target() const;
 
         ~SoftLinkedFile() = default;
     private:
-        shared_ptr<Directory> rootCopy;
+        // Links are resolved by readers in parallel, so the cache is atomic. The number is stored before the
+        // generation of the arena it is valid for, and read after it.
+        mutable std::atomic<uint64_t> cachedTarget{0};
+        mutable std::atomic<uint64_t> cachedGeneration{0};
+
+        // The root of the tree the link is in
+        const Directory& root() const;
     };
 } //GTUShell namespace
 
-#endif //SOFTLINKEDFILE_H
\ No newline at end of file
+#endif //SOFTLINKEDFILE_H
@@ -0,0 +1,106 @@
+#include "Timestamp.h"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+namespace GTUShell {
+    namespace {
+        const char monthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+        // Days between 1970-01-01 and the date of the proleptic Gregorian calendar
+        int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+            unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+            unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+            return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+        }
+
+        void civilFromDays(int64_t days, int64_t& year, unsigned& month, unsigned& day) {
+            days += 719468;
+            int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+            unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            unsigned monthIndex = (5 * dayOfYear + 2) / 153;
+            day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+            month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+            year = static_cast<int64_t>(yearOfEra) + era * 400 + (month <= 2);
+        }
+
+        // Reads count digits at text, false if one of them is not a digit
+        bool readNumber(const char* text, int count, unsigned& value) {
+            value = 0;
+            for (int i = 0; i < count; i++) {
+                if (text[i] < '0' || text[i] > '9')
+                    return false;
+                value = value * 10 + static_cast<unsigned>(text[i] - '0');
+            }
+            return true;
+        }
+
+        void writeNumber(char* out, unsigned value, int count) {
+            for (int i = count - 1; i >= 0; i--) {
+                out[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        }
+    }
+
+    int64_t Timestamp::now() {
+        std::time_t currentTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        std::tm localTime{};
+        localtime_r(&currentTime, &localTime);
+        int64_t days = daysFromCivil(localTime.tm_year + 1900, static_cast<unsigned>(localTime.tm_mon + 1),
+                                     static_cast<unsigned>(localTime.tm_mday));
+        return days * 86400 + localTime.tm_hour * 3600 + localTime.tm_min * 60;
+    }
+
+    int64_t Timestamp::parse(const string& text) {
+        // "Mmm dd yyyy hh:mm"
+        if (text.size() != formattedSize || text[3] != ' ' || text[6] != ' ' || text[11] != ' ' || text[14] != ':')
+            return unknown;
+
+        const char* found = strstr(monthNames, text.substr(0, 3).c_str());
+        if (!found || (found - monthNames) % 3 != 0)
+            return unknown;
+        unsigned month = static_cast<unsigned>((found - monthNames) / 3 + 1);
+
+        unsigned day, year, hour, minute;
+        const char* digits = text.data();
+        if (!readNumber(digits + 4, 2, day) || !readNumber(digits + 7, 4, year) || !readNumber(digits + 12, 2, hour)
+            || !readNumber(digits + 15, 2, minute) || day < 1 || day > 31 || hour > 23 || minute > 59)
+            return unknown;
+
+        return daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60;
+    }
+
+    size_t Timestamp::format(int64_t time, char* out) {
+        if (time == unknown)
+            return 0;
+
+        int64_t days = time >= 0 ? time / 86400 : (time - 86399) / 86400;
+        int64_t seconds = time - days * 86400;
+        int64_t year;
+        unsigned month, day;
+        civilFromDays(days, year, month, day);
+
+        memcpy(out, monthNames + (month - 1) * 3, 3);
+        out[3] = ' ';
+        writeNumber(out + 4, day, 2);
+        out[6] = ' ';
+        writeNumber(out + 7, static_cast<unsigned>(year), 4);
+        out[11] = ' ';
+        writeNumber(out + 12, static_cast<unsigned>(seconds / 3600), 2);
+        out[14] = ':';
+        writeNumber(out + 15, static_cast<unsigned>(seconds / 60 % 60), 2);
+        return formattedSize;
+    }
+
+    string Timestamp::format(int64_t time) {
+        char formatted[formattedSize];
+        return string(formatted, format(time, formatted));
+    }
+} //GTUShell namespace
@@ -0,0 +1,33 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using std::string;
+
+namespace GTUShell {
+    // Dates are kept as seconds since 1970 of the local clock, so they compare as integers. They are shown and stored
+    // on the disk as "%b %d %Y %H:%M" ("Jan 05 2024 00:39"), which is parsed and formatted here without the C library.
+    class Timestamp {
+    public:
+        // A date that could not be read, it is shown as an empty string
+        static constexpr int64_t unknown = INT64_MIN;
+
+        // Length of a formatted date
+        static constexpr size_t formattedSize = 17;
+
+        // The current minute
+        static int64_t now();
+
+        // Reads a formatted date, unknown if the text is not one
+        static int64_t parse(const string& text);
+
+        // Writes the date to out (formattedSize bytes), returns the number of bytes written
+        static size_t format(int64_t time, char* out);
+        static string format(int64_t time);
+    };
+} //GTUShell namespace
+
+#endif //TIMESTAMP_H
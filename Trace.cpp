@@ -0,0 +1,76 @@
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+namespace GTUShell {
+    LogWriter Trace::log;
+
+    namespace {
+        chrono::steady_clock::time_point epoch;
+        atomic<int> nextThreadId{1};
+
+        // Small ids are easier to read in the viewer than the ids of the system
+        int threadId() {
+            thread_local int id = nextThreadId++;
+            return id;
+        }
+
+        void appendEscaped(string& out, const string& text) {
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += c;
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+            }
+        }
+    }
+
+    bool Trace::start(const string& path) {
+        // The events are the elements of one JSON array
+        epoch = chrono::steady_clock::now();
+        return log.open(path, "[\n", ",\n", "\n]\n");
+    }
+
+    void Trace::stop() {
+        log.close();
+    }
+
+    int64_t Trace::now() {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    void Trace::addSpan(const char* name, int64_t start, int64_t duration, size_t bytes, size_t records,
+                        const string& detail) {
+        string event = "{\"name\":\"";
+        appendEscaped(event, name);
+        event += "\",\"cat\":\"shell\",\"ph\":\"X\",\"ts\":" + to_string(start) + ",\"dur\":" + to_string(duration) +
+                 ",\"pid\":1,\"tid\":" + to_string(threadId()) + ",\"args\":{\"bytes\":" + to_string(bytes) +
+                 ",\"records\":" + to_string(records);
+        if (!detail.empty()) {
+            event += ",\"detail\":\"";
+            appendEscaped(event, detail);
+            event += "\"";
+        }
+        event += "}}";
+        log.add(event);
+    }
+
+    void Trace::nameThread(const string& name) {
+        if (!enabled())
+            return;
+        string event = "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + to_string(threadId()) +
+                       ",\"args\":{\"name\":\"";
+        appendEscaped(event, name);
+        event += "\"}}";
+        log.add(event);
+    }
+} //GTUShell namespace
@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "LogWriter.h"
+
+namespace GTUShell {
+    // Writes spans to a file in the Chrome trace event format, which chrome://tracing, Perfetto and speedscope
+    // load. Every span is a complete event of the thread it ran on, so a span that runs inside another one on the
+    // same thread is shown nested in it.
+    class Trace {
+    public:
+        // Starts writing events to the file, false if it can not be opened. The file is finished by stop, which also
+        // runs at exit.
+        static bool start(const std::string& path);
+        static void stop();
+
+        // True while a trace is being written. Only a relaxed load, so spans cost next to nothing without a trace.
+        static bool enabled() { return log.isOpen(); }
+
+        // Microseconds since the trace was started
+        static int64_t now();
+
+        // Adds a span of the calling thread
+        static void addSpan(const char* name, int64_t start, int64_t duration, size_t bytes, size_t records,
+                            const std::string& detail);
+
+        // Gives the calling thread a name in the viewer
+        static void nameThread(const std::string& name);
+
+    private:
+        static LogWriter log;
+    };
+
+    // Adds its scope to the trace as a span, does nothing when no trace is written
+    class TraceSpan {
+    public:
+        explicit TraceSpan(const char* nameVal) : name(Trace::enabled() ? nameVal : nullptr), start(name ? Trace::now() : 0) { }
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+        ~TraceSpan() {
+            if (name)
+                Trace::addSpan(name, start, Trace::now() - start, bytes, records, detail);
+        }
+
+        // True if the span is recorded, details that take work to build are only built then
+        bool active() const { return name != nullptr; }
+
+        // Adds to the byte and record counts shown with the span
+        void count(size_t bytesVal, size_t recordsVal) {
+            bytes += bytesVal;
+            records += recordsVal;
+        }
+
+        // Text shown with the span, like the command line
+        void setDetail(const std::string& detailVal) {
+            if (name)
+                detail = detailVal;
+        }
+
+    private:
+        const char* name;
+        int64_t start;
+        size_t bytes = 0;
+        size_t records = 0;
+        std::string detail;
+    };
+} //GTUShell namespace
+
+#endif //TRACE_H
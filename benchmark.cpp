@@ -0,0 +1,882 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <random>
+#include <unistd.h>
+
+#include "DiskImage.h"
+#include "Directory.h"
+#include "ImageSync.h"
+#include "LzCodec.h"
+#include "RecordScanner.h"
+#include "RegularFile.h"
+#include "Shell.h"
+#include "Timestamp.h"
+#include "Trace.h"
+
+using namespace GTUShell;
+using namespace std;
+
+// Micro benchmarks for the storage layer.
+// Usage: ./benchmark <name> [arguments], run it without arguments to see the list of benchmarks.
+
+namespace {
+    // Number of heap allocations made by the benchmark so far and the heap bytes that are in use
+    atomic<size_t> allocationCount{0};
+    atomic<size_t> liveBytes{0};
+}
+
+void* operator new(size_t size) {
+    allocationCount++;
+    if (void* memory = malloc(size == 0 ? 1 : size)) {
+        liveBytes += malloc_usable_size(memory);
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    if (memory)
+        liveBytes -= malloc_usable_size(memory);
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+namespace {
+    double secondsOf(const function<void()>& work) {
+        auto start = chrono::steady_clock::now();
+        work();
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Counts the bytes written to it and drops them, so a listing is measured without a terminal
+    class CountingBuffer : public streambuf {
+    public:
+        size_t bytes = 0;
+
+    protected:
+        int overflow(int c) override {
+            bytes++;
+            return c;
+        }
+
+        streamsize xsputn(const char*, streamsize count) override {
+            bytes += count;
+            return count;
+        }
+    };
+
+    double megabytes(size_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    // Builds log-like text files, the kind of content the shell mostly stores
+    vector<FileData> sampleFiles(size_t fileCount, size_t fileSize) {
+        const vector<string> levels = { "INFO", "WARN", "DEBUG", "ERROR" };
+        const vector<string> messages = { "request served", "cache miss for key", "connection opened from",
+                                          "retrying operation", "user logged in", "disk usage at" };
+        mt19937 random(42);
+
+        vector<FileData> files;
+        for (size_t i = 0; i < fileCount; i++) {
+            FileData data = { 'F', "file" + to_string(i) + ".log", "/file" + to_string(i) + ".log",
+                              "Jan 01 2024 00:00", 0, "" };
+            while (data.content.size() < fileSize) {
+                data.content += "2024-01-01 12:" + to_string(random() % 60) + ":" + to_string(random() % 60) + " "
+                                + levels[random() % levels.size()] + " " + messages[random() % messages.size()]
+                                + " " + to_string(random() % 100000) + "\n";
+            }
+            data.size = static_cast<int>(data.content.size());
+            files.push_back(data);
+        }
+        return files;
+    }
+
+    // Removes the segment files and the manifest of a disk
+    void removeImage(const string& path) {
+        unlink((path + ".manifest").c_str());
+        unlink(path.c_str());
+        for (int id = 1; unlink((path + "." + to_string(id)).c_str()) == 0; id++) { }
+    }
+
+    string writeImage(const string& path, const vector<FileData>& files, bool compression) {
+        removeImage(path);
+        DiskImage disk(path);
+        disk.setDurable(false);
+        disk.setCompression(compression);
+        disk.append({ 'D', ".", Directory::inodeKey(InodeTable::rootNumber), "Jan 01 2024 00:00", 0, "" });
+
+        // An inode record and an entry record in the root for every file
+        uint64_t number = InodeTable::rootNumber + 1;
+        for (const auto& data : files) {
+            FileData record = data;
+            record.path = Directory::inodeKey(number);
+            disk.append(record);
+            disk.append({ 'E', data.name, Directory::entryKey(InodeTable::rootNumber, data.name), data.date, 0,
+                          to_string(number++) });
+        }
+        disk.sync();
+        return path;
+    }
+
+    // Ratio and throughput of LzCodec, and what it costs to load and cat a compressed disk
+    int compressionBenchmark(int argc, char* argv[]) {
+        size_t fileCount = argc >= 1 ? stoul(argv[0]) : 200;
+        size_t fileSize = argc >= 2 ? stoul(argv[1]) : 16 * 1024;
+        vector<FileData> files = sampleFiles(fileCount, fileSize);
+
+        size_t original = 0;
+        size_t compressedSize = 0;
+        vector<string> compressed;
+        double compressSeconds = secondsOf([&] {
+            for (const auto& data : files)
+                compressed.push_back(LzCodec::compress(data.content));
+        });
+        double decompressSeconds = secondsOf([&] {
+            for (size_t i = 0; i < files.size(); i++)
+                LzCodec::decompress(compressed[i], files[i].content.size());
+        });
+        for (size_t i = 0; i < files.size(); i++) {
+            original += files[i].content.size();
+            compressedSize += compressed[i].size();
+        }
+
+        cout << fixed << setprecision(2);
+        cout << "Contents: " << fileCount << " files, " << megabytes(original) << " MB\n";
+        cout << "Ratio: " << static_cast<double>(compressedSize) / original << " (compressed / original)\n";
+        cout << "Compress: " << megabytes(original) / compressSeconds << " MB/s, decompress: "
+             << megabytes(original) / decompressSeconds << " MB/s\n\n";
+
+        cout << left << setw(14) << "disk" << setw(12) << "size (MB)" << setw(14) << "load (ms)" << "cat (MB/s)\n";
+        for (bool compression : { false, true }) {
+            string path = writeImage(compression ? "benchmark_lz.txt" : "benchmark_raw.txt", files, compression);
+            DiskImage disk(path);
+
+            NodeArena arena;
+            Directory root;
+            root.setEntry(".", arena.inodes().create({ 'D', ".", "/", "0", 0, "" }, InodeTable::rootNumber));
+            root.setDisk(shared_ptr<DiskImage>(&disk, [](DiskImage*) { }));
+            root.setArena(&arena);
+            double loadSeconds = secondsOf([&] { root.readDiskFile(cout); });
+
+            // The first read of each file pays for its decompression
+            size_t bytes = 0;
+            unsigned checksum = 0;
+            double catSeconds = secondsOf([&] {
+                for (const auto& filePtr : root.getFiles()) {
+                    for (auto it = filePtr->begin(), endIt = filePtr->end(); it != endIt; ++it) {
+                        checksum += static_cast<unsigned char>(*it);
+                        bytes++;
+                    }
+                }
+            });
+            if (checksum == 1)
+                cout << "";
+
+            cout << left << setw(14) << (compression ? "compressed" : "raw") << setw(12) << megabytes(disk.physicalSize())
+                 << setw(14) << loadSeconds * 1000 << megabytes(bytes) / catSeconds << "\n";
+            removeImage(path);
+        }
+        return 0;
+    }
+
+    // Load time and the cost of removing a single file for a large disk, with one segment and with segments
+    int segmentsBenchmark(int argc, char* argv[]) {
+        size_t imageMegabytes = argc >= 1 ? stoul(argv[0]) : 200;
+        double segmentMegabytes = argc >= 2 ? stod(argv[1]) : 4;
+        const size_t fileSize = 64 * 1024;
+
+        // Random hex text, so that the size of the disk does not depend on compression
+        mt19937 random(7);
+        string content(fileSize, ' ');
+        size_t fileCount = imageMegabytes * 1024 * 1024 / fileSize;
+
+        cout << fixed << setprecision(2);
+        cout << "Disk of " << imageMegabytes << " MB, " << fileCount << " files\n";
+        cout << left << setw(16) << "segment (MB)" << setw(10) << "segments" << setw(12) << "load (ms)"
+             << setw(12) << "rm (ms)" << "rm rewrites (MB)\n";
+
+        for (double segmentSize : { static_cast<double>(imageMegabytes) * 2, segmentMegabytes }) {
+            const string path = "benchmark_segments.txt";
+            removeImage(path);
+            {
+                DiskImage disk(path);
+                disk.setDurable(false);
+                disk.setCompression(false);
+                disk.setSegmentSize(static_cast<size_t>(segmentSize * 1024 * 1024));
+                disk.append({ 'D', ".", "/", "Jan 01 2024 00:00", 0, "" });
+                for (size_t i = 0; i < fileCount; i++) {
+                    for (auto& c : content)
+                        c = "0123456789abcdef"[random() & 15];
+                    disk.append({ 'F', "file" + to_string(i), "/file" + to_string(i), "Jan 01 2024 00:00",
+                                  static_cast<int>(fileSize), content });
+                }
+                disk.sync();
+            }
+
+            DiskImage disk(path);
+            disk.setSegmentSize(static_cast<size_t>(segmentSize * 1024 * 1024));
+            double loadSeconds = secondsOf([&] { disk.load(cout); });
+
+            // Remove a file from the middle of the disk, only its segment is rewritten
+            size_t before = disk.physicalSize();
+            size_t segmentCount = disk.segmentCount();
+            double rmSeconds = secondsOf([&] {
+                disk.removeRecords({ "/file" + to_string(fileCount / 2) });
+                disk.sync();
+            });
+            double rewritten = min(static_cast<double>(before), segmentSize * 1024 * 1024);
+
+            cout << left << setw(16) << segmentSize << setw(10) << segmentCount << setw(12) << loadSeconds * 1000
+                 << setw(12) << rmSeconds * 1000 << megabytes(static_cast<size_t>(rewritten)) << "\n";
+            removeImage(path);
+        }
+        return 0;
+    }
+
+    // Reads a large directory through its iterators and counts the allocations made while iterating
+    int iterateBenchmark(int argc, char* argv[]) {
+        size_t entryCount = argc >= 1 ? stoul(argv[0]) : 100000;
+
+        NodeArena arena;
+        Directory dir;
+        dir.setEntry("big", arena.inodes().create({ 'D', "big", "/big", "Jan 01 2024 00:00", 0, "" }));
+        dir.setArena(&arena);
+        for (size_t i = 0; i < entryCount; i++)
+            dir.addFile(arena.create({ 'F', "entry" + to_string(i), "", "Jan 01 2024 00:00", 0, "" }, nullptr));
+
+        size_t bytes = 0;
+        unsigned checksum = 0;
+        size_t allocations = 0;
+        double seconds = secondsOf([&] {
+            // Counted inside, so the std::function of secondsOf is not included
+            size_t allocationsBefore = allocationCount;
+            for (auto it = dir.begin(), endIt = dir.end(); it != endIt; ++it) {
+                checksum += static_cast<unsigned char>(*it);
+                bytes++;
+            }
+            allocations = allocationCount - allocationsBefore;
+        });
+
+        // Adding a child invalidates the iterators taken before
+        auto it = dir.begin();
+        dir.addFile(arena.create({ 'F', "late", "", "Jan 01 2024 00:00", 0, "" }, nullptr));
+        bool invalidated = false;
+        try {
+            checksum += *it;
+        } catch (const IteratorInvalidated&) {
+            invalidated = true;
+        }
+
+        cout << fixed << setprecision(2);
+        cout << "Entries: " << entryCount << ", bytes: " << bytes << " (checksum " << checksum << ")\n";
+        cout << "Iterate: " << seconds * 1000 << " ms, " << megabytes(bytes) / seconds << " MB/s, allocations: "
+             << allocations << "\n";
+        cout << "Iterator invalidated by a modification: " << (invalidated ? "yes" : "no") << "\n";
+        return 0;
+    }
+
+    // Load time, heap memory and cd latency of a shell with a large tree
+    int treeBenchmark(int argc, char* argv[]) {
+        size_t entryCount = argc >= 1 ? stoul(argv[0]) : 1000000;
+        const size_t filesPerDirectory = 1000;
+        const size_t depth = 10;
+        const string date = "Jan 01 2024 00:00";
+        const string path = "benchmark_tree.txt";
+
+        removeImage(path);
+        {
+            DiskImage disk(path);
+            disk.setDurable(false);
+            disk.setCompression(false);
+            disk.append({ 'D', ".", Directory::inodeKey(InodeTable::rootNumber), date, 0, "" });
+
+            // Every entry is an inode record and an entry record in its directory
+            uint64_t number = InodeTable::rootNumber + 1;
+            auto addEntry = [&](const FileData& data, uint64_t directoryNumber) {
+                FileData record = data;
+                record.path = Directory::inodeKey(number);
+                disk.append(record);
+                disk.append({ 'E', data.name, Directory::entryKey(directoryNumber, data.name), date, 0,
+                              to_string(number) });
+                return number++;
+            };
+
+            // A chain of nested directories to cd through, and the rest of the entries in directories of 1000 files
+            uint64_t chainNumber = InodeTable::rootNumber;
+            for (size_t level = 0; level < depth; level++)
+                chainNumber = addEntry({ 'D', "n" + to_string(level), "", date, 0, "" }, chainNumber);
+            size_t written = depth;
+            for (size_t i = 0; written < entryCount; i++) {
+                uint64_t dirNumber = addEntry({ 'D', "d" + to_string(i), "", date, 0, "" }, InodeTable::rootNumber);
+                written++;
+                for (size_t j = 0; j < filesPerDirectory && written < entryCount; j++, written++)
+                    addEntry({ 'F', "f" + to_string(j), "", date, 1, "x" }, dirNumber);
+            }
+            disk.sync();
+        }
+
+        size_t bytesBefore = liveBytes;
+        Shell shell(path);
+        double loadSeconds = secondsOf([&] { shell.load(cout); });
+        size_t treeBytes = liveBytes - bytesBefore;
+
+        // Go to the bottom of the chain, then go up and down the last level
+        Session session;
+        ostringstream ignored;
+        for (size_t level = 0; level + 1 < depth; level++)
+            shell.execute(session, "cd n" + to_string(level), ignored);
+        const string down = "cd n" + to_string(depth - 1);
+        const string up = "cd ..";
+        const size_t cdCount = 200000;
+        double cdSeconds = secondsOf([&] {
+            for (size_t i = 0; i < cdCount; i++)
+                shell.execute(session, i % 2 == 0 ? down : up, ignored);
+        });
+
+        cout << fixed << setprecision(2);
+        cout << "Entries: " << entryCount << ", disk: " << megabytes(shell.getDisk().physicalSize()) << " MB\n";
+        cout << "Load: " << loadSeconds * 1000 << " ms, heap: " << megabytes(treeBytes) << " MB ("
+             << treeBytes / entryCount << " bytes per entry)\n";
+        cout << "cd at depth " << depth << ": " << cdSeconds / cdCount * 1e6 << " us\n";
+
+        // List the whole tree from the root
+        Session rootSession;
+        for (const string command : { "ls -R", "ls -R --json", "ls -R -0" }) {
+            CountingBuffer counter;
+            ostream out(&counter);
+            size_t allocationsBefore = allocationCount;
+            double lsSeconds = secondsOf([&] { shell.execute(rootSession, command, out); });
+            cout << left << setw(14) << command << lsSeconds * 1000 << " ms, " << megabytes(counter.bytes) << " MB, "
+                 << allocationCount - allocationsBefore << " allocations\n";
+        }
+        removeImage(path);
+        return 0;
+    }
+
+    // Exports a full disk (10MB by default) to a host directory
+    int exportBenchmark(int argc, char* argv[]) {
+        size_t imageMegabytes = argc >= 1 ? stoul(argv[0]) : 10;
+        const size_t fileSize = 16 * 1024;
+        const string path = writeImage("benchmark_export.txt", sampleFiles(imageMegabytes * 1024 * 1024 / fileSize, fileSize),
+                                       false);
+        const string hostDir = "benchmark_export";
+
+        Shell shell(path);
+        shell.load(cout);
+        Session session;
+        ostringstream report;
+        double seconds = secondsOf([&] { shell.execute(session, "export . " + hostDir, report); });
+
+        cout << fixed << setprecision(2);
+        cout << "Disk: " << megabytes(shell.getDisk().physicalSize()) << " MB\n" << report.str();
+        cout << "Export command: " << seconds * 1000 << " ms\n";
+
+        std::error_code error;
+        filesystem::remove_all(hostDir, error);
+        removeImage(path);
+        return 0;
+    }
+
+    // Appends log lines to one growing file through the shell, an append costs the same at any file size
+    int appendBenchmark(int argc, char* argv[]) {
+        size_t lineCount = argc >= 1 ? stoul(argv[0]) : 200000;
+        const size_t rounds = 10;
+        const string path = "benchmark_append.txt";
+
+        removeImage(path);
+        {
+            DiskImage disk(path);
+            disk.append(Directory::rootRecord());
+            disk.sync();
+        }
+
+        string stat;
+        cout << fixed << setprecision(2);
+        cout << left << setw(10) << "lines" << setw(16) << "us per append" << "disk (MB)\n";
+        {
+            Shell shell(path);
+            // fsync is measured by loadtest, this measures the work of an append
+            shell.getDisk().setDurable(false);
+            shell.load(cout);
+
+            Session session;
+            ostringstream ignored;
+            for (size_t round = 1; round <= rounds; round++) {
+                double seconds = secondsOf([&] {
+                    for (size_t i = 0; i < lineCount / rounds; i++)
+                        shell.execute(session, "append app.log 2024-01-01 12:00:00 INFO request served " + to_string(i),
+                                      ignored);
+                    shell.getDisk().sync();
+                });
+                cout << left << setw(10) << round * (lineCount / rounds) << setw(16)
+                     << seconds / (lineCount / rounds) * 1e6 << megabytes(shell.getDisk().physicalSize()) << "\n";
+            }
+
+            ostringstream out;
+            shell.execute(session, "stat app.log", out);
+            stat = out.str();
+        }
+
+        // The deltas are replayed when the disk is loaded again
+        Shell shell(path);
+        double loadSeconds = secondsOf([&] { shell.load(cout); });
+        Session session;
+        ostringstream out;
+        shell.execute(session, "stat app.log", out);
+        cout << "Load: " << loadSeconds * 1000 << " ms, same content after load: " << (out.str() == stat ? "yes" : "no")
+             << "\n";
+        removeImage(path);
+        return 0;
+    }
+
+    // Pages of a directory with many files in the name, size and date orders, against listing the whole order
+    int pageBenchmark(int argc, char* argv[]) {
+        size_t fileCount = argc >= 1 ? stoul(argv[0]) : 200000;
+        const string path = "benchmark_page.txt";
+        mt19937 random(42);
+
+        removeImage(path);
+        {
+            DiskImage disk(path);
+            disk.setDurable(false);
+            disk.setCompression(false);
+            disk.append(Directory::rootRecord());
+
+            // Files with random names, sizes and dates in one directory
+            vector<FileData> batch;
+            for (size_t i = 0; i < fileCount; i++) {
+                uint64_t number = InodeTable::rootNumber + 1 + i;
+                string name = "f" + to_string(random() % 1000000000);
+                int64_t time = Timestamp::parse("Jan 01 2024 00:00") + static_cast<int64_t>(random() % 500000) * 60;
+                string date = Timestamp::format(time);
+                string content(random() % 64, 'x');
+                batch.push_back({ 'F', name, Directory::inodeKey(number), date, static_cast<int>(content.size()),
+                                  content });
+                batch.push_back({ 'E', name, Directory::entryKey(InodeTable::rootNumber, name), date, 0,
+                                  to_string(number) });
+            }
+            disk.append(batch);
+            disk.sync();
+        }
+
+        Shell shell(path);
+        shell.load(cout);
+        Session session;
+
+        const vector<string> commands = { "ls --sort name --limit 20", "ls --sort name --limit 20 --after f5",
+                                          "ls --sort name --offset 100000 --limit 20", "ls -S --limit 20",
+                                          "ls -t --limit 20", "ls -t --offset 1000 --limit 20", "ls -S", "ls -t" };
+        const size_t rounds = 20;
+        cout << fixed << setprecision(2);
+        cout << "Files: " << fileCount << "\n";
+        for (const auto& command : commands) {
+            CountingBuffer counter;
+            ostream out(&counter);
+            double seconds = secondsOf([&] {
+                for (size_t i = 0; i < rounds; i++)
+                    shell.execute(session, command, out);
+            });
+            cout << left << setw(44) << command << seconds / rounds * 1000 << " ms\n";
+        }
+        removeImage(path);
+        return 0;
+    }
+
+    // Mounts images that are only read when they are used: mounting costs the same for any image size, the first
+    // use of a mount point pays for reading its image
+    int mountBenchmark(int argc, char* argv[]) {
+        size_t imageCount = argc >= 1 ? stoul(argv[0]) : 8;
+        size_t fileCount = argc >= 2 ? stoul(argv[1]) : 50000;
+        const string path = "benchmark_mount.txt";
+
+        vector<string> images;
+        for (size_t i = 0; i < imageCount; i++) {
+            images.push_back("benchmark_mount_" + to_string(i) + ".txt");
+            removeImage(images.back());
+            DiskImage disk(images.back());
+            disk.setDurable(false);
+            disk.setCompression(false);
+            disk.append(Directory::rootRecord());
+            vector<FileData> batch;
+            for (size_t j = 0; j < fileCount; j++) {
+                uint64_t number = InodeTable::rootNumber + 1 + j;
+                string name = "f" + to_string(j);
+                string date = Timestamp::format(Timestamp::now());
+                batch.push_back({ 'F', name, Directory::inodeKey(number), date, 4, "data" });
+                batch.push_back({ 'E', name, Directory::entryKey(InodeTable::rootNumber, name), date, 0,
+                                  to_string(number) });
+            }
+            disk.append(batch);
+            disk.sync();
+        }
+        removeImage(path);
+        {
+            DiskImage disk(path);
+            disk.append(Directory::rootRecord());
+            disk.sync();
+        }
+
+        Shell shell(path);
+        shell.getDisk().setDurable(false);
+        shell.getDisk().setQuota(SIZE_MAX, DiskImage::QuotaMode::physical);
+        shell.load(cout);
+        Session session;
+        CountingBuffer counter;
+        ostream out(&counter);
+
+        double mountSeconds = secondsOf([&] {
+            for (size_t i = 0; i < imageCount; i++)
+                shell.execute(session, "mount " + images[i] + " m" + to_string(i), out);
+        });
+        double firstSeconds = secondsOf([&] {
+            shell.execute(session, "cd m0", out);
+            shell.execute(session, "ls --limit 1", out);
+        });
+        shell.execute(session, "cd ..", out);
+        double allSeconds = secondsOf([&] {
+            for (size_t i = 1; i < imageCount; i++) {
+                shell.execute(session, "cd m" + to_string(i), out);
+                shell.execute(session, "ls --limit 1", out);
+                shell.execute(session, "cd ..", out);
+            }
+        });
+
+        cout << fixed << setprecision(2);
+        cout << "Images: " << imageCount << ", files per image: " << fileCount << "\n";
+        cout << left << setw(28) << "mount every image" << mountSeconds * 1000 << " ms\n";
+        cout << left << setw(28) << "first use of one image" << firstSeconds * 1000 << " ms\n";
+        cout << left << setw(28) << "first use of the others" << allSeconds * 1000 << " ms\n";
+
+        for (size_t i = 0; i < imageCount; i++)
+            shell.execute(session, "umount m" + to_string(i), out);
+        for (const auto& image : images)
+            removeImage(image);
+        removeImage(path);
+        return 0;
+    }
+
+    // Imports a host directory as a job and runs ls in the foreground until it ends. The host files are read
+    // before the tree is locked, so ls only waits while the files are added to the tree.
+    int jobsBenchmark(int argc, char* argv[]) {
+        size_t fileCount = argc >= 1 ? stoul(argv[0]) : 2000;
+        const size_t fileSize = 16 * 1024;
+        const string path = "benchmark_jobs.txt";
+        const string hostDir = "benchmark_jobs";
+
+        std::error_code error;
+        filesystem::remove_all(hostDir, error);
+        filesystem::create_directory(hostDir);
+        vector<FileData> files = sampleFiles(fileCount, fileSize);
+        for (const auto& file : files)
+            ofstream(hostDir + "/" + file.name, ios::binary) << file.content;
+        removeImage(path);
+        {
+            DiskImage disk(path);
+            disk.append(Directory::rootRecord());
+            disk.sync();
+        }
+
+        Shell shell(path);
+        shell.getDisk().setDurable(false);
+        shell.getDisk().setQuota(SIZE_MAX, DiskImage::QuotaMode::physical);
+        shell.load(cout);
+        Session session;
+        CountingBuffer counter;
+        ostream out(&counter);
+
+        vector<double> latencies;
+        double seconds = secondsOf([&] {
+            shell.execute(session, "import " + hostDir + " imported &", out);
+            ostringstream jobs;
+            do {
+                latencies.push_back(secondsOf([&] { shell.execute(session, "ls", out); }));
+                jobs.str("");
+                shell.execute(session, "jobs", jobs);
+            } while (!jobs.str().empty());
+        });
+        sort(latencies.begin(), latencies.end());
+        double total = 0;
+        for (double latency : latencies)
+            total += latency;
+
+        cout << fixed << setprecision(2);
+        cout << "Files: " << fileCount << " (" << megabytes(fileCount * fileSize) << " MB)\n";
+        cout << left << setw(28) << "import job" << seconds * 1000 << " ms\n";
+        cout << left << setw(28) << "ls during the job" << latencies.size() << " runs, "
+             << total / latencies.size() * 1000 << " ms on average, " << latencies.back() * 1000 << " ms at most\n";
+
+        filesystem::remove_all(hostDir, error);
+        removeImage(path);
+        return 0;
+    }
+
+    // Runs the same commands without and with a trace, without one the spans should cost next to nothing
+    int traceBenchmark(int argc, char* argv[]) {
+        size_t commandCount = argc >= 1 ? stoul(argv[0]) : 100000;
+        const string path = "benchmark_trace.txt";
+        const string tracePath = "benchmark_trace.json";
+        const vector<string> commands = { "write notes.txt first line", "cat notes.txt", "ls", "cd .", "append notes.txt more" };
+
+        cout << fixed << setprecision(2);
+        cout << left << setw(10) << "trace" << setw(16) << "us per command" << "trace (MB)\n";
+        for (bool traced : { false, true }) {
+            removeImage(path);
+            {
+                DiskImage disk(path);
+                disk.append(Directory::rootRecord());
+                disk.sync();
+            }
+            if (traced && !Trace::start(tracePath)) {
+                cout << "Cannot write the trace to " << tracePath << "\n";
+                return 1;
+            }
+
+            double seconds;
+            {
+                Shell shell(path);
+                shell.getDisk().setDurable(false);
+                shell.load(cout);
+
+                Session session;
+                ostringstream ignored;
+                seconds = secondsOf([&] {
+                    for (size_t i = 0; i < commandCount; i++) {
+                        shell.execute(session, commands[i % commands.size()], ignored);
+                        ignored.str("");
+                    }
+                    shell.getDisk().sync();
+                });
+            }
+
+            Trace::stop();
+            cout << left << setw(10) << (traced ? "on" : "off") << setw(16) << seconds / commandCount * 1e6
+                 << (traced ? megabytes(filesystem::file_size(tracePath)) : 0.0) << "\n";
+        }
+
+        removeImage(path);
+        filesystem::remove(tracePath);
+        return 0;
+    }
+    // Load throughput of the record parser at every level of RecordScanner the CPU has, for a disk with length fields
+    // and for an older one whose contents are read line by line
+    int scanBenchmark(int argc, char* argv[]) {
+        double diskMegabytes = argc >= 1 ? stod(argv[0]) : 64;
+        const size_t fileSize = 1024;
+        size_t fileCount = static_cast<size_t>(diskMegabytes * 1024 * 1024 / (fileSize + 96));
+        vector<FileData> files = sampleFiles(fileCount, fileSize);
+
+        const string path = "benchmark_scan.txt";
+        const string olderPath = "benchmark_scan_older.txt";
+        writeImage(path, files, false);
+        removeImage(olderPath);
+        {
+            ofstream older(olderPath, ios::binary);
+            for (const auto& data : files) {
+                older << data.type << "\t" << data.path << "\t" << data.name << "\t" << data.date << "\t" << data.size
+                      << "\n~0~\n" << data.content << "~0~\n";
+            }
+        }
+
+        // Splitting every line of the disk into its tabs shows the scanner without the records that are built
+        string buffer;
+        {
+            ifstream input(path, ios::binary);
+            buffer.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+        }
+        size_t tabs[8];
+
+        cout << fixed << setprecision(2);
+        cout << "Records: " << fileCount * 2 << " with " << fileSize << " byte contents\n";
+        cout << left << setw(10) << "level" << setw(14) << "scan (GB/s)" << setw(18) << "load disk (GB/s)"
+             << "load older disk (GB/s)\n";
+        for (auto level : { RecordScanner::Level::scalar, RecordScanner::Level::sse2, RecordScanner::Level::avx2 }) {
+            if (static_cast<int>(level) > static_cast<int>(RecordScanner::bestLevel()))
+                break;
+            RecordScanner::setLevel(level);
+            cout << left << setw(10) << RecordScanner::nameOf(level);
+
+            size_t lines = 0;
+            double best = 1e9;
+            for (int run = 0; run < 5; run++) {
+                best = min(best, secondsOf([&] {
+                    size_t tabCount;
+                    for (size_t pos = 0; pos < buffer.size(); lines++)
+                        pos = RecordScanner::scanLine(buffer.data(), pos, buffer.size(), tabs, 8, tabCount) + 1;
+                }));
+            }
+            if (lines == 1)
+                cout << "";
+            cout << setw(14) << buffer.size() / best / 1e9;
+            for (const string& image : { path, olderPath }) {
+                // The best of a few loads, the files are in the page cache after the first one
+                DiskImage disk(image);
+                double bestLoad = 1e9;
+                for (int run = 0; run < 5; run++)
+                    bestLoad = min(bestLoad, secondsOf([&] { disk.load(cout); }));
+                cout << setw(18) << disk.physicalSize() / bestLoad / 1e9;
+            }
+            cout << "\n";
+        }
+        RecordScanner::setLevel(RecordScanner::bestLevel());
+
+        removeImage(path);
+        removeImage(olderPath);
+        return 0;
+    }
+
+    // Loads a disk with a damaged record in the middle of its segment and a torn write at its end: only the damaged
+    // record may be lost, the torn end is cut off, and removing a record later keeps the records after the damage
+    int recoveryBenchmark(int argc, char* argv[]) {
+        size_t fileCount = argc >= 1 ? stoul(argv[0]) : 400;
+        const string path = "benchmark_recovery.txt";
+        vector<FileData> files = sampleFiles(fileCount, 4096);
+        writeImage(path, files, false);
+        size_t recordCount = 1 + 2 * fileCount;
+        size_t intactSize = filesystem::file_size(path);
+
+        // One flipped byte in the middle, then half of a record as an interrupted append would leave it
+        {
+            fstream image(path, ios::in | ios::out | ios::binary);
+            image.seekg(static_cast<streamoff>(intactSize / 2));
+            char byte = static_cast<char>(image.get());
+            image.seekp(static_cast<streamoff>(intactSize / 2));
+            image.put(static_cast<char>(byte ^ 1));
+            image.seekp(0, ios::end);
+            string torn = DiskImage::formatRecord(files[0]);
+            image << torn.substr(0, torn.size() / 2);
+        }
+
+        bool passed = true;
+        auto check = [&](const string& what, bool condition) {
+            cout << left << setw(48) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        vector<FileData> loaded;
+        double seconds;
+        {
+            DiskImage disk(path);
+            disk.setDurable(false);
+            seconds = secondsOf([&] { loaded = disk.load(cout); });
+            check("only the damaged record is skipped", loaded.size() == recordCount - 1);
+            check("the torn write is cut off", filesystem::file_size(path) == intactSize);
+
+            // The removal rewrites the segment, the damaged bytes and every record after them stay
+            disk.removeRecords({ loaded.back().path });
+            disk.sync();
+        }
+        {
+            DiskImage disk(path);
+            check("a rewrite keeps the records after the damage", disk.load(cout).size() == recordCount - 2);
+        }
+        cout << fixed << setprecision(2) << left << setw(48) << "load with the damage" << seconds * 1000 << " ms\n";
+
+        removeImage(path);
+        return passed ? 0 : 1;
+    }
+
+    // Syncs a copy of an image after a few bytes of its largest file and one small file were changed: only the
+    // changed blocks of the large file and the small file should be sent
+    int imgsyncBenchmark(int argc, char* argv[]) {
+        size_t largeSize = static_cast<size_t>((argc >= 1 ? stod(argv[0]) : 10) * 1024 * 1024);
+        const string sourcePath = "benchmark_imgsync_source.txt";
+        const string destinationPath = "benchmark_imgsync_destination.txt";
+
+        vector<FileData> files = sampleFiles(1, largeSize);
+        vector<FileData> small = sampleFiles(100, 4096);
+        files.insert(files.end(), small.begin() + 1, small.end());
+        writeImage(sourcePath, files, true);
+        removeImage(destinationPath);
+        DiskImage(sourcePath).copyImage(destinationPath);
+
+        // The first file is inode 2, the second one inode 3
+        {
+            DiskImage source(sourcePath);
+            source.setDurable(false);
+            source.load(cout);
+            FileData large = files[0];
+            large.path = Directory::inodeKey(InodeTable::rootNumber + 1);
+            for (size_t offset : { largeSize / 4, largeSize / 2, largeSize / 4 * 3 })
+                large.content.replace(offset, 5, "12345");
+            large.content.insert(largeSize / 3, "an inserted line\n");
+            large.size = static_cast<int>(large.content.size());
+            FileData changed = files[1];
+            changed.path = Directory::inodeKey(InodeTable::rootNumber + 2);
+            changed.content = "rewritten\n";
+            changed.size = static_cast<int>(changed.content.size());
+            source.removeRecords({ large.path, changed.path });
+            source.append({ large, changed });
+            source.sync();
+        }
+
+        ImageSync::SyncReport report;
+        double seconds = secondsOf([&] { report = ImageSync::sync(sourcePath, destinationPath); });
+        size_t changes = ImageSync::diff(sourcePath, destinationPath).size();
+
+        cout << fixed << setprecision(2);
+        cout << "Files: " << files.size() << " (" << megabytes(report.sourceBytes) << " MB)\n";
+        cout << left << setw(28) << "sync" << seconds * 1000 << " ms\n";
+        cout << left << setw(28) << "keys replaced" << report.replacedKeys << " of "
+             << report.keptKeys + report.replacedKeys << "\n";
+        cout << left << setw(28) << "bytes sent" << report.sentBytes << " (" << megabytes(report.reusedBytes)
+             << " MB reused)\n";
+        cout << left << setw(28) << "differences after the sync" << changes << "\n";
+
+        removeImage(sourcePath);
+        removeImage(destinationPath);
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const map<string, function<int(int, char*[])>> benchmarks = {
+            {"compression", compressionBenchmark},
+            {"segments", segmentsBenchmark},
+            {"iterate", iterateBenchmark},
+            {"tree", treeBenchmark},
+            {"export", exportBenchmark},
+            {"append", appendBenchmark},
+            {"page", pageBenchmark},
+            {"mount", mountBenchmark},
+            {"jobs", jobsBenchmark},
+            {"trace", traceBenchmark},
+            {"imgsync", imgsyncBenchmark},
+            {"scan", scanBenchmark},
+            {"recovery", recoveryBenchmark}
+    };
+
+    if (argc < 2 || benchmarks.find(argv[1]) == benchmarks.end()) {
+        cout << "Usage: ./benchmark <name> [arguments]\n";
+        cout << "  compression [files] [file size]\n";
+        cout << "  segments [disk MB] [segment MB]\n";
+        cout << "  iterate [entries]\n";
+        cout << "  tree [entries]\n";
+        cout << "  export [disk MB]\n";
+        cout << "  append [lines]\n";
+        cout << "  page [files]\n";
+        cout << "  mount [images] [files per image]\n";
+        cout << "  jobs [files]\n";
+        cout << "  trace [commands]\n";
+        cout << "  imgsync [large file MB]\n";
+        cout << "  scan [disk MB]\n";
+        cout << "  recovery [files]\n";
+        return 1;
+    }
+
+    try {
+        return benchmarks.at(argv[1])(argc - 2, argv + 2);
+    } catch (const ShellExceptions& err) {
+        cout << err.what() << "\n";
+        return 1;
+    }
+}
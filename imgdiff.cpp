@@ -0,0 +1,38 @@
+#include <iostream>
+
+#include "ImageSync.h"
+#include "ShellExceptions.h"
+
+using namespace GTUShell;
+using namespace std;
+
+// Lists the entries that were added, removed or changed from the first image to the second one. Exits with 1 when
+// the images differ, like diff.
+// Usage: ./imgdiff <a> <b>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cout << "Usage: ./imgdiff <a> <b>\n";
+        return 2;
+    }
+    try {
+        size_t added = 0, removed = 0, changed = 0;
+        for (const auto& change : ImageSync::diff(argv[1], argv[2])) {
+            cout << change.kind << " " << change.path;
+            if (!change.detail.empty())
+                cout << " (" << change.detail << ")";
+            cout << "\n";
+            if (change.kind == '+')
+                added++;
+            else if (change.kind == '-')
+                removed++;
+            else
+                changed++;
+        }
+        cout << added << " added, " << removed << " removed, " << changed << " changed\n";
+        return added + removed + changed == 0 ? 0 : 1;
+    } catch (const ShellExceptions& err) {
+        cout << err.what() << "\n";
+        return 2;
+    }
+}
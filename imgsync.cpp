@@ -0,0 +1,38 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "ImageSync.h"
+#include "ShellExceptions.h"
+
+using namespace GTUShell;
+using namespace std;
+
+// Brings the destination image up to date with the source one, writing only the keys that changed. The report
+// tells how many bytes a copy over the network would have sent.
+// Usage: ./imgsync <source> <destination>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cout << "Usage: ./imgsync <source> <destination>\n";
+        return 1;
+    }
+    try {
+        auto start = chrono::steady_clock::now();
+        ImageSync::SyncReport report = ImageSync::sync(argv[1], argv[2]);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "Keys: " << report.keptKeys << " kept, " << report.addedKeys << " added, " << report.removedKeys
+             << " removed, " << report.replacedKeys << " replaced, " << report.appendedRecords
+             << " append records added\n";
+        cout << fixed << setprecision(2);
+        cout << "Sent " << report.sentBytes << " bytes for " << report.sourceBytes / 1048576.0
+             << " MB of content, " << report.reusedBytes / 1048576.0 << " MB rebuilt from "
+             << report.deltaRecords << " old contents\n";
+        cout << "Done in " << seconds * 1000 << " ms\n";
+        return 0;
+    } catch (const ShellExceptions& err) {
+        cout << err.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,97 @@
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ShellClient.h"
+#include "ShellExceptions.h"
+
+using namespace GTUShell;
+using namespace std;
+
+// Measures the throughput of a running daemon (./output --daemon) with 1 to 64 concurrent sessions.
+// Usage: ./loadtest [socket] [seconds per level] [write percent]
+
+struct WorkerResult {
+    long operations = 0;
+    double busySeconds = 0;
+};
+
+void runWorker(const string& socketPath, int workerId, int writePercent,
+               chrono::steady_clock::time_point deadline, WorkerResult& result) {
+    ShellClient client(socketPath);
+    string reply;
+    client.readReply(reply);
+
+    // Sessions stay in the root directory so the writers always find the directory they created
+    const vector<string> readCommands = { "ls", "ls -R", "cat ." };
+    mt19937 random(workerId);
+    uniform_int_distribution<int> percent(0, 99);
+
+    // Writers alternate between creating and removing their own directory so the disk does not grow
+    string dirName = "loadtest_" + to_string(workerId);
+    bool dirCreated = false;
+    size_t readIndex = 0;
+
+    while (chrono::steady_clock::now() < deadline) {
+        string command;
+        if (percent(random) < writePercent) {
+            command = (dirCreated ? "rmdir " : "mkdir ") + dirName;
+            dirCreated = !dirCreated;
+        } else {
+            command = readCommands[readIndex++ % readCommands.size()];
+        }
+
+        auto start = chrono::steady_clock::now();
+        client.request(command);
+        result.busySeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        result.operations++;
+    }
+
+    if (dirCreated)
+        client.request("rmdir " + dirName);
+}
+
+int main(int argc, char* argv[]) {
+    string socketPath = argc >= 2 ? argv[1] : defaultSocketPath;
+    double seconds = argc >= 3 ? stod(argv[2]) : 2.0;
+    int writePercent = argc >= 4 ? stoi(argv[3]) : 10;
+
+    cout << "Load test on " << socketPath << ", " << seconds << "s per level, "
+         << writePercent << "% writes\n";
+    cout << left << setw(10) << "sessions" << setw(12) << "ops" << setw(14) << "ops/s" << "avg latency (us)\n";
+
+    try {
+        for (int sessions = 1; sessions <= 64; sessions *= 2) {
+            vector<WorkerResult> results(sessions);
+            vector<thread> workers;
+            auto deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                    chrono::duration<double>(seconds));
+
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < sessions; i++)
+                workers.emplace_back(runWorker, socketPath, i, writePercent, deadline, ref(results[i]));
+            for (auto& worker : workers)
+                worker.join();
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            long operations = 0;
+            double busySeconds = 0;
+            for (const auto& result : results) {
+                operations += result.operations;
+                busySeconds += result.busySeconds;
+            }
+
+            cout << left << setw(10) << sessions << setw(12) << operations
+                 << setw(14) << fixed << setprecision(0) << operations / elapsed
+                 << setprecision(1) << (operations ? busySeconds / operations * 1e6 : 0) << "\n";
+        }
+    } catch (const SocketError& err) {
+        cout << err.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
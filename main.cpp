@@ -1,223 +1,204 @@
 #include <iostream>
 #include <sstream>
-#include <unordered_map>
+#include <cmath>
+#include <cstdlib>
+#include <csignal>
+#include <cstring>
+#include <thread>
 
 #include "File.h"
 #include "RegularFile.h"
 #include "Directory.h"
 #include "SoftLinkedFile.h"
+#include "Shell.h"
+#include "ShellServer.h"
+#include "ShellClient.h"
+#include "LogWriter.h"
+#include "Recorder.h"
+#include "Trace.h"
 
 using namespace GTUShell;
 using namespace std;
 
 
-enum class Commands {
-    ls, mkdir, rm, cp, link, cd, cat, rmdir
-};
-
-int main() {
+// Waits for SIGINT, SIGTERM or SIGHUP, writes the queued changes of the disk and ends the program
+void flushOnSignal(Shell& shell, sigset_t signals) {
+    int signalNumber = 0;
+    sigwait(&signals, &signalNumber);
     try {
-        // Create an unordered map to check for the command input
-        unordered_map<string, Commands> commandMap = {
-                {"ls", Commands::ls},
-                {"mkdir", Commands::mkdir},
-                {"rm", Commands::rm},
-                {"cp", Commands::cp},
-                {"link", Commands::link},
-                {"cd", Commands::cd},
-                {"cat", Commands::cat},
-                {"rmdir", Commands::rmdir}
-        };
-
-        // Set up the data for the root directory
-        FileData rootData = {
-                'D', ".", "/", "0", 0, ""
-        };
-
-        Directory root;
-        root.setData(rootData);
-        root.readDiskFile();
-
-        Directory currentDirectory = root;
-        string currentPath = "/";
+        shell.sync();
+    } catch (const ShellExceptions& err) {
+        cout << err.what() << "\n";
+    }
+    // _exit skips the exit handlers, the trace and the log of the sessions are finished here
+    LogWriter::closeAll();
+    cout << "\n";
+    _exit(128 + signalNumber);
+}
+
+void printUsage() {
+    cout << "Usage: ./output [--daemon [socket] | --connect [socket]] [--quota MB] [--quota-mode physical|logical]\n"
+         << "                [--segment-size MB] [--no-compress] [--trace file] [--record file] [--no-sync]\n";
+}
+
+// Reads a positive number of megabytes, false if the text is not one
+bool parseMegabytes(const char* text, size_t& bytes) {
+    char* end = nullptr;
+    double megabytes = strtod(text, &end);
+    if (end == text || *end != '\0' || !(megabytes > 0) || megabytes > 1024 * 1024)
+        return false;
+    bytes = static_cast<size_t>(llround(megabytes * 1024 * 1024));
+    return true;
+}
+
+// Forwards the lines of the standard input to a running daemon and prints its replies
+int runClient(const string& socketPath) {
+    ShellClient client(socketPath);
+
+    string reply;
+    if (!client.readReply(reply))
+        return 1;
+    cout << reply << flush;
+
+    string inputStr;
+    while (getline(cin, inputStr)) {
+        cout << client.request(inputStr) << flush;
+    }
+    cout << "\n";
+    return 0;
+}
 
+int main(int argc, char* argv[]) {
+    // The signals are blocked before any thread is started, so only the signal thread receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
-        while(true) {
-            // Get the command input from the user as a string
-            string inputStr;
-            inputStr.erase();
-            cout << currentPath <<  " > ";
-            getline(cin, inputStr);
-
-            // Check if inputStr is empty or it only has whitespaces
-            if(inputStr.empty() || inputStr.find_first_not_of(' ') == std::string::npos)
-                continue;
-
-            // Parse the words of the string
-            istringstream inputss(inputStr);
-            string word;
-            vector<string> words;
-            word.erase();
-            while(inputss >> word) {
-                words.push_back(word);
+    try {
+        // Read the options, a socket path can follow --daemon and --connect
+        bool daemonMode = false;
+        bool clientMode = false;
+        bool durable = true;
+        bool compression = true;
+        string socketPath = defaultSocketPath;
+        string tracePath;
+        string recordPath;
+        size_t quotaBytes = 10 * 1024 * 1024;
+        size_t segmentBytes = 4 * 1024 * 1024;
+        DiskImage::QuotaMode quotaMode = DiskImage::QuotaMode::physical;
+
+        for (int i = 1; i < argc; i++) {
+            string option = argv[i];
+            bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+
+            if (option == "--daemon" || option == "--connect") {
+                daemonMode = option == "--daemon";
+                clientMode = option == "--connect";
+                if (hasValue)
+                    socketPath = argv[++i];
+            } else if (option == "--no-sync") {
+                // Skips fsync calls, it is only meant for measuring the cost of durability
+                durable = false;
+            } else if (option == "--no-compress") {
+                compression = false;
+            } else if (option == "--segment-size" || option == "--quota") {
+                // Size of a segment file or quota, in megabytes
+                size_t& bytes = option == "--quota" ? quotaBytes : segmentBytes;
+                if (!hasValue || !parseMegabytes(argv[++i], bytes)) {
+                    cout << "Invalid value for " << option << ", a positive number of megabytes is expected\n";
+                    printUsage();
+                    return 1;
+                }
+            } else if (option == "--quota-mode" && hasValue) {
+                // physical counts the bytes of disk.txt, logical counts the bytes before compression
+                quotaMode = string(argv[++i]) == "logical" ? DiskImage::QuotaMode::logical : DiskImage::QuotaMode::physical;
+            } else if (option == "--trace" && hasValue) {
+                // Chrome trace events of the commands and the disk, written to the file
+                tracePath = argv[++i];
+            } else if (option == "--record" && hasValue) {
+                // Log of every command line for ./replay, with a copy of the image it starts from
+                recordPath = argv[++i];
+            } else {
+                cout << "Unknown option: " << option << "\n";
+                printUsage();
+                return 1;
             }
+        }
 
-            // Make the command word lowercase
-            if (!words.empty()) {
-                for (auto& c : words[0])
-                    c = tolower(c);
-            }
-            string command = words[0];
+        if (clientMode)
+            return runClient(socketPath);
 
-            // If command map's end is reached, then the command does not exist in the map
-            if(commandMap.find(command) == commandMap.end()) {
-                cout << "Command not found: " << command << "\n";
-                continue;
+        // Started before the shell, so the disk writer thread is named in the trace
+        if (!tracePath.empty()) {
+            if (!Trace::start(tracePath)) {
+                cout << "Cannot write the trace to " << tracePath << "\n";
+                return 1;
             }
+            Trace::nameThread("shell");
+        }
 
-            // Execute the commands
-            switch (commandMap[command]) {
-                case (Commands::ls): {
-                    if(words.size() < 2) {
-                        currentDirectory.ls(currentPath, currentDirectory, root);
-                    } else if(words.size() >= 2 && words[1] == "-R") {
-                        currentDirectory.lsRecursive(currentDirectory);
-                    }
-                    break;
-                }
-                case (Commands::mkdir): {
-                   try {
-                       if(words.size() < 2)
-                           continue;
-
-                        string dirName = words[1];
-                        currentDirectory.mkdir(dirName, currentPath);
-
-                    } catch (DirectoryAlreadyExists& err) {
-                        cout << err.what() << "\n";
-                    }
-                    break;
-                }
-                case (Commands::rm): {
-                    if(words.size() < 2)
-                        continue;
-
-                    string fileName = words[1];
-                    string pathValue;
-                    if(currentPath.back() == '/') pathValue = currentPath + fileName;
-                    else pathValue = currentPath + "/" + fileName;
-
-                    try {
-                        currentDirectory.rm(pathValue);
-                    } catch(PathNotFound& err) {
-                        cout << err.what() << "\n";
-                    } catch(ContentsFileNotFound& err) {
-                        cout << err.what() << "\n";
-                    } catch(FileIsDirectory& err) {
-                        cout << err.what() << "\n";
-                    }
-
-                    break;
-                }
-                case (Commands::rmdir): {
-                    if(words.size() < 2)
-                        continue;
-
-                    string fileName = words[1];
-                    string pathValue;
-                    if(currentPath.back() == '/') pathValue = currentPath + fileName;
-                    else pathValue = currentPath + "/" + fileName;
-
-                    try {
-                        currentDirectory.rmdir(pathValue);
-                    } catch(PathNotFound& err) {
-                        cout << err.what() << "\n";
-                    } catch(ContentsFileNotFound& err) {
-                        cout << err.what() << "\n";
-                    } catch(NotDirectory& err) {
-                        cout << err.what() << "\n";
-                    }
-                    break;
-                }
-                case (Commands::cp): {
-                    if(words.size() < 2)
-                        continue;
-                    string sourcePath = words[1];
-                    try {
-                        currentDirectory.cp(sourcePath);
-                    } catch (PathNotFound& err) {
-                        cout << err.what() << "\n";
-                    } catch(FileIsDirectory& err) {
-                        cout << err.what() << "\n";
-                    }
-
-
-                    break;
-                }
-                case (Commands::link): {
-                    if(words.size() < 3)
-                        continue;
-                    string sourceFile = words[1];
-                    string targetName = words[2];
-                    currentDirectory.link(sourceFile, targetName, root);
-                    break;
-                }
-                case (Commands::cd): {
-                    if(words.size() < 2)
-                        continue;
-                    string newDir = words[1];
-                    Directory::cd(currentPath, root, currentDirectory, newDir);
-                    break;
-                }
-                case (Commands::cat): {
-                    try {
-                        //  Flag to see if a command is executed successfully
-                        bool executedFlag = false;
-
-                        string filename = words[1];
-                        if(!filename.empty()) {
-                            for (const auto& filePtr : currentDirectory.getFiles()) {
-                                if (filePtr->getName() == filename) {
-                                    filePtr->cat();
-                                    executedFlag = true;
-                                    break;
-                                }
-                            }
-                            if(!executedFlag) {
-                                cout << "No such file or directory: " << filename << "\n";
-                            }
-                        }
-                    } catch(const FileNotFound& err) {
-                        cout << err.what() << "\n";
-                    } catch(const FileIsDirectory& err) {
-                        cout << err.what() << "\n";
-                    }
-                    break;
-                }
-                default:
-                    cout << "Command not found: " << command << "\n";
+        Shell shell;
+        shell.getDisk().setDurable(durable);
+        shell.getDisk().setCompression(compression);
+        shell.getDisk().setQuota(quotaBytes, quotaMode);
+        shell.getDisk().setSegmentSize(segmentBytes);
+        if (!recordPath.empty() && !Recorder::start(recordPath, shell.getDisk())) {
+            cout << "Cannot write the log of the sessions to " << recordPath << "\n";
+            return 1;
+        }
+        shell.load(cout);
+        thread(flushOnSignal, ref(shell), signals).detach();
+
+        if (daemonMode) {
+            ShellServer server(shell, socketPath);
+            server.run();
+            return 0;
+        }
+
+        Session session;
+
+        while(true) {
+            // Get the command input from the user as a string
+            string inputStr;
+            cout << Shell::prompt(session);
+            if (!getline(cin, inputStr)) {
+                cout << "\n";
+                break;
             }
-            // Read the disk file after updating it
-            root.readDiskFile();
+
             try {
-                // Check if the disk size exceeds 10MB
-                File::checkDiskSize();
+                shell.execute(session, inputStr, cout);
             } catch (DiskExceedsLimit& err) {
-                cout << err.what() << "\n";
+                cout << err.what() << ", terminating the system...\n\n\n";
+                shell.sync();
                 exit(1);
             }
         }
     } catch(const ContentsFileNotFound& err) {
-        // disk.txt was not found, create it
-        FileData rootData = {
-                'D', ".", "/", "0", 0, ""
-        };
-        Directory::addToDiskFile(rootData);
+        // disk.txt was not found, create it with the record of the root
+        DiskImage disk("disk.txt");
+        disk.append(Directory::rootRecord());
+        disk.sync();
         cout << err.what() << "\n";
     } catch(const FileTypeInvalid& err) {
+        cout << "Program terminated: " << err.what() << ".\nYou may delete disk.txt and start the program again.\n\n";
+    } catch(const SegmentNotFound& err) {
+        cout << "Program terminated: " << err.what() << ".\n\n";
+        return 1;
+    } catch(const RecordDamaged& err) {
+        cout << "Program terminated: " << err.what() << ".\nRepair or remove the record and start the program again.\n\n";
+        return 1;
+    } catch(const DiskWriteFailed& err) {
+        cout << err.what() << "\n";
+        return 1;
+    } catch(const SocketError& err) {
         cout << err.what() << "\n";
+        return 1;
     } catch(...) {
-        // Catch if some other exception occurs// Iterator overrides
+        // Catch if some other exception occurs
         cout << "Unhandled exception!\n";
         try {
             throw; // Throw the exception again to get the details
@@ -228,4 +209,4 @@ int main() {
         }
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "DiskImage.h"
+#include "Recorder.h"
+#include "Shell.h"
+
+using namespace GTUShell;
+using namespace std;
+
+// Runs the command lines of a log written with ./output --record again, against a copy of the image the log
+// started from, and reports the latency of every command. Every session runs on a thread of its own, like the
+// sessions of the daemon. Lines that use host paths or other images (mount, import, export) are skipped.
+// Usage: ./replay <log> [--paced] [--out latencies.tsv]
+//        ./replay --compare <a.tsv> <b.tsv>
+
+namespace {
+    struct Command {
+        int64_t time;
+        uint64_t session;
+        string line;
+    };
+
+    struct Log {
+        string imagePath;
+        string checksum;
+        bool durable = true;
+        bool compression = true;
+        size_t quota = 0;
+        DiskImage::QuotaMode quotaMode = DiskImage::QuotaMode::physical;
+        size_t segmentSize = 0;
+        vector<Command> commands;
+    };
+
+    // One row of a latency file
+    struct Latency {
+        string command;
+        double micros;
+        string line;
+    };
+
+    // Splits the line at the first count tabs, the last field keeps its tabs
+    vector<string> splitFields(const string& line, size_t count) {
+        vector<string> fields;
+        size_t start = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t tab = line.find('\t', start);
+            if (tab == string::npos)
+                break;
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(line.substr(start));
+        return fields;
+    }
+
+    bool readLog(const string& path, Log& log) {
+        ifstream input(path);
+        if (!input.is_open()) {
+            cout << "Cannot read " << path << "\n";
+            return false;
+        }
+
+        string line;
+        while (getline(input, line)) {
+            if (line.compare(0, 6, "image\t") == 0) {
+                vector<string> fields = splitFields(line, 2);
+                if (fields.size() == 3) {
+                    log.imagePath = fields[1];
+                    log.checksum = fields[2];
+                }
+            } else if (line.compare(0, 9, "settings\t") == 0) {
+                vector<string> fields = splitFields(line, 5);
+                if (fields.size() == 6) {
+                    log.durable = fields[1] == "1";
+                    log.compression = fields[2] == "1";
+                    log.quota = stoull(fields[3]);
+                    log.quotaMode = fields[4] == "logical" ? DiskImage::QuotaMode::logical
+                                                           : DiskImage::QuotaMode::physical;
+                    log.segmentSize = stoull(fields[5]);
+                }
+            } else {
+                vector<string> fields = splitFields(line, 2);
+                if (fields.size() == 3)
+                    log.commands.push_back({ stoll(fields[0]), stoull(fields[1]), fields[2] });
+            }
+        }
+        if (log.imagePath.empty() || log.segmentSize == 0) {
+            cout << path << " is not a log written with --record\n";
+            return false;
+        }
+        return true;
+    }
+
+    // The name of the command, or "job" for a line that ends with &
+    string commandOf(const string& line) {
+        size_t lastChar = line.find_last_not_of(" \t");
+        if (lastChar != string::npos && line[lastChar] == '&')
+            return "job";
+        istringstream words(line);
+        string word;
+        words >> word;
+        for (auto& c : word)
+            c = static_cast<char>(tolower(c));
+        return word;
+    }
+
+    // Host paths and other images are not part of the copy, a replay must not read or change them
+    bool usesHostPaths(const string& line) {
+        istringstream stages(line);
+        string stage;
+        while (getline(stages, stage, '|')) {
+            istringstream words(stage);
+            string word;
+            words >> word;
+            for (auto& c : word)
+                c = static_cast<char>(tolower(c));
+            if (word == "mount" || word == "import" || word == "export")
+                return true;
+        }
+        return false;
+    }
+
+    double percentile(const vector<double>& sorted, double fraction) {
+        return sorted[min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+    }
+
+    void printTable(const map<string, vector<double> >& latencies) {
+        // The commands that took the most time in total come first
+        vector<pair<double, string> > order;
+        for (const auto& command : latencies) {
+            double total = 0;
+            for (double micros : command.second)
+                total += micros;
+            order.emplace_back(total, command.first);
+        }
+        sort(order.rbegin(), order.rend());
+
+        cout << fixed << setprecision(1);
+        cout << left << setw(10) << "command" << right << setw(8) << "count" << setw(12) << "total ms" << setw(12)
+             << "mean us" << setw(12) << "p50 us" << setw(12) << "p99 us" << setw(12) << "max us" << "\n";
+        for (const auto& entry : order) {
+            vector<double> sorted = latencies.at(entry.second);
+            sort(sorted.begin(), sorted.end());
+            cout << left << setw(10) << entry.second << right << setw(8) << sorted.size() << setw(12)
+                 << entry.first / 1000 << setw(12) << entry.first / sorted.size() << setw(12) << percentile(sorted, 0.5)
+                 << setw(12) << percentile(sorted, 0.99) << setw(12) << sorted.back() << "\n";
+        }
+    }
+
+    int replay(const string& logPath, bool paced, const string& outPath) {
+        Log log;
+        if (!readLog(logPath, log))
+            return 1;
+
+        // The copy kept next to the log must be the image the log started from
+        string recordedImage = Recorder::imagePath(logPath);
+        DiskImage recorded(recordedImage);
+        char checksum[9];
+        snprintf(checksum, sizeof(checksum), "%08x", recorded.imageChecksum());
+        if (log.checksum != checksum) {
+            cout << recordedImage << " has checksum " << checksum << ", the log started from " << log.checksum << "\n";
+            return 1;
+        }
+
+        // Every replay works on a fresh copy, so two runs (and two builds) start from the same files
+        filesystem::path workDir = filesystem::temp_directory_path() / ("replay_" + to_string(getpid()));
+        filesystem::create_directories(workDir);
+        string imagePath = (workDir / filesystem::path(log.imagePath).filename()).string();
+        recorded.copyImage(imagePath);
+
+        vector<Latency> rows;
+        map<string, vector<double> > latencies;
+        double loadSeconds, replaySeconds, syncSeconds;
+        size_t outputBytes = 0;
+        size_t skippedCount = 0;
+        size_t sessionCount = 0;
+        {
+            Shell shell(imagePath);
+            shell.getDisk().setDurable(log.durable);
+            shell.getDisk().setCompression(log.compression);
+            shell.getDisk().setQuota(log.quota, log.quotaMode);
+            shell.getDisk().setSegmentSize(log.segmentSize);
+
+            auto start = chrono::steady_clock::now();
+            shell.load(cout);
+            loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            // The lines of every session, in the order they were recorded
+            map<uint64_t, vector<size_t> > linesOfSession;
+            vector<bool> skipped(log.commands.size());
+            for (size_t i = 0; i < log.commands.size(); i++) {
+                skipped[i] = usesHostPaths(log.commands[i].line);
+                if (skipped[i])
+                    skippedCount++;
+                else
+                    linesOfSession[log.commands[i].session].push_back(i);
+            }
+
+            // Every session runs its lines in order on a thread of its own, so sessions that ran at the same time
+            // compete for the tree like they did. Without --paced the lines of different sessions can run in
+            // another order than they were recorded in.
+            vector<double> micros(log.commands.size());
+            atomic<size_t> totalOutput{0};
+            start = chrono::steady_clock::now();
+            auto runSession = [&](uint64_t id, const vector<size_t>& lines) {
+                Session session;
+                session.id = id;
+                for (size_t i : lines) {
+                    const Command& command = log.commands[i];
+                    if (paced)
+                        this_thread::sleep_until(start + chrono::microseconds(command.time));
+
+                    ostringstream out;
+                    auto commandStart = chrono::steady_clock::now();
+                    try {
+                        shell.execute(session, command.line, out);
+                    } catch (const ShellExceptions& err) {
+                        out << err.what() << "\n";
+                    }
+                    micros[i] = chrono::duration<double, micro>(chrono::steady_clock::now() - commandStart).count();
+                    totalOutput += out.str().size();
+                }
+
+                // Jobs that are still running are part of the workload
+                ostringstream out;
+                shell.execute(session, "wait", out);
+            };
+            vector<thread> threads;
+            for (const auto& session : linesOfSession)
+                threads.emplace_back(runSession, session.first, cref(session.second));
+            sessionCount = linesOfSession.size();
+            for (auto& sessionThread : threads)
+                sessionThread.join();
+            replaySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            outputBytes = totalOutput;
+
+            for (size_t i = 0; i < log.commands.size(); i++) {
+                if (skipped[i])
+                    continue;
+                rows.push_back({ commandOf(log.commands[i].line), micros[i], log.commands[i].line });
+                latencies[rows.back().command].push_back(micros[i]);
+            }
+
+            start = chrono::steady_clock::now();
+            shell.sync();
+            syncSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        filesystem::remove_all(workDir);
+
+        cout << fixed << setprecision(2);
+        cout << "Replayed " << rows.size() << " commands of " << latencies.size() << " kinds in " << sessionCount
+             << " sessions, one thread each" << (paced ? ", at the recorded pace" : "") << ", in "
+             << replaySeconds * 1000 << " ms (load " << loadSeconds * 1000 << " ms, final sync " << syncSeconds * 1000
+             << " ms, " << outputBytes << " bytes of output)\n";
+        if (skippedCount > 0) {
+            cout << "Skipped " << skippedCount << " lines with mount, import or export, the replay does not use host "
+                 << "paths or other images\n";
+        }
+        if (!log.commands.empty())
+            printTable(latencies);
+
+        if (!outPath.empty()) {
+            ofstream out(outPath, ios::trunc);
+            out << fixed << setprecision(1);
+            for (size_t i = 0; i < rows.size(); i++)
+                out << i << "\t" << rows[i].command << "\t" << rows[i].micros << "\t" << rows[i].line << "\n";
+        }
+        return 0;
+    }
+
+    bool readLatencies(const string& path, vector<Latency>& rows) {
+        ifstream input(path);
+        if (!input.is_open()) {
+            cout << "Cannot read " << path << "\n";
+            return false;
+        }
+        string line;
+        while (getline(input, line)) {
+            vector<string> fields = splitFields(line, 3);
+            if (fields.size() == 4)
+                rows.push_back({ fields[1], stod(fields[2]), fields[3] });
+        }
+        return true;
+    }
+
+    // Compares the latency files of two replays of the same log, for example by two builds
+    int compare(const string& firstPath, const string& secondPath) {
+        vector<Latency> first, second;
+        if (!readLatencies(firstPath, first) || !readLatencies(secondPath, second))
+            return 1;
+        if (first.size() != second.size()) {
+            cout << "The files have " << first.size() << " and " << second.size() << " commands, they are not replays "
+                 << "of the same log\n";
+            return 1;
+        }
+        for (size_t i = 0; i < first.size(); i++) {
+            if (first[i].line != second[i].line) {
+                cout << "Command " << i << " differs: " << first[i].line << " | " << second[i].line << "\n";
+                return 1;
+            }
+        }
+
+        map<string, pair<double, double> > totals;
+        map<string, size_t> counts;
+        double firstTotal = 0, secondTotal = 0;
+        for (size_t i = 0; i < first.size(); i++) {
+            totals[first[i].command].first += first[i].micros;
+            totals[first[i].command].second += second[i].micros;
+            counts[first[i].command]++;
+            firstTotal += first[i].micros;
+            secondTotal += second[i].micros;
+        }
+
+        cout << fixed << setprecision(1);
+        cout << left << setw(10) << "command" << right << setw(8) << "count" << setw(14) << "first us" << setw(14)
+             << "second us" << setw(10) << "change" << "\n";
+        auto printRow = [](const string& name, size_t count, double firstMicros, double secondMicros) {
+            cout << left << setw(10) << name << right << setw(8) << count << setw(14) << firstMicros / count
+                 << setw(14) << secondMicros / count << setw(9) << (secondMicros / firstMicros - 1) * 100 << "%\n";
+        };
+        for (const auto& total : totals)
+            printRow(total.first, counts[total.first], total.second.first, total.second.second);
+        if (!first.empty())
+            printRow("all", first.size(), firstTotal, secondTotal);
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        if (argc == 4 && string(argv[1]) == "--compare")
+            return compare(argv[2], argv[3]);
+
+        string logPath;
+        string outPath;
+        bool paced = false;
+        for (int i = 1; i < argc; i++) {
+            string option = argv[i];
+            if (option == "--paced") {
+                paced = true;
+            } else if (option == "--out" && i + 1 < argc) {
+                outPath = argv[++i];
+            } else if (logPath.empty() && option[0] != '-') {
+                logPath = option;
+            } else {
+                cout << "Unknown option: " << option << "\n";
+                return 1;
+            }
+        }
+        if (logPath.empty()) {
+            cout << "Usage: ./replay <log> [--paced] [--out latencies.tsv]\n";
+            cout << "       ./replay --compare <a.tsv> <b.tsv>\n";
+            return 1;
+        }
+        return replay(logPath, paced, outPath);
+    } catch (const ShellExceptions& err) {
+        cout << err.what() << "\n";
+        return 1;
+    }
+}